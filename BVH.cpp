@@ -0,0 +1,245 @@
+#include "BVH.hpp"
+
+#include "frustum_planes.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//most items a leaf may hold before it is split:
+static constexpr uint32_t LeafSize = 4;
+
+static float surface_area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void BVH::build(std::vector< Box > const &boxes_) {
+	boxes = boxes_;
+	nodes.clear();
+	items.resize(boxes.size());
+	for (uint32_t i = 0; i < items.size(); ++i) {
+		items[i] = i;
+	}
+	if (boxes.empty()) {
+		build_cost = cost = 0.0f;
+		return;
+	}
+
+	nodes.reserve(2 * (boxes.size() / LeafSize + 1));
+
+	std::vector< glm::vec3 > centers(boxes.size());
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		centers[i] = 0.5f * (boxes[i].min + boxes[i].max);
+	}
+
+	//split ranges of items at the median of their centers along the longest axis of the centers' bounds:
+	// (nodes are pushed in depth-first order, so children always come after parents)
+	struct Todo {
+		uint32_t node;
+		uint32_t begin, end;
+	};
+	std::vector< Todo > todo;
+	nodes.emplace_back();
+	todo.emplace_back(Todo{0, 0, uint32_t(items.size())});
+	while (!todo.empty()) {
+		Todo t = todo.back();
+		todo.pop_back();
+
+		Node &node = nodes[t.node];
+		node.min = glm::vec3( std::numeric_limits< float >::infinity());
+		node.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 center_min = node.min;
+		glm::vec3 center_max = node.max;
+		for (uint32_t i = t.begin; i < t.end; ++i) {
+			node.min = glm::min(node.min, boxes[items[i]].min);
+			node.max = glm::max(node.max, boxes[items[i]].max);
+			center_min = glm::min(center_min, centers[items[i]]);
+			center_max = glm::max(center_max, centers[items[i]]);
+		}
+
+		glm::vec3 spread = center_max - center_min;
+		if (t.end - t.begin <= LeafSize || (spread.x <= 0.0f && spread.y <= 0.0f && spread.z <= 0.0f)) {
+			node.first = t.begin;
+			node.count = t.end - t.begin;
+			continue;
+		}
+
+		int axis = 0;
+		if (spread.y > spread[axis]) axis = 1;
+		if (spread.z > spread[axis]) axis = 2;
+
+		uint32_t mid = t.begin + (t.end - t.begin) / 2;
+		std::nth_element(items.begin() + t.begin, items.begin() + mid, items.begin() + t.end, [&centers,axis](uint32_t a, uint32_t b){
+			return centers[a][axis] < centers[b][axis];
+		});
+
+		uint32_t left = uint32_t(nodes.size());
+		node.first = left;
+		node.count = 0;
+		nodes.emplace_back(); //n.b. invalidates 'node'
+		nodes.emplace_back();
+		todo.emplace_back(Todo{left + 1, mid, t.end});
+		todo.emplace_back(Todo{left, t.begin, mid});
+	}
+
+	build_cost = cost = compute_cost();
+}
+
+void BVH::refit(std::vector< Box > const &boxes_) {
+	assert(boxes_.size() == boxes.size());
+	boxes = boxes_;
+
+	//children come after parents, so a backward pass sees children first:
+	for (uint32_t n = uint32_t(nodes.size()) - 1; n < nodes.size(); --n) {
+		Node &node = nodes[n];
+		if (node.count) {
+			node.min = glm::vec3( std::numeric_limits< float >::infinity());
+			node.max = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				node.min = glm::min(node.min, boxes[items[i]].min);
+				node.max = glm::max(node.max, boxes[items[i]].max);
+			}
+		} else {
+			node.min = glm::min(nodes[node.first].min, nodes[node.first+1].min);
+			node.max = glm::max(nodes[node.first].max, nodes[node.first+1].max);
+		}
+	}
+
+	cost = compute_cost();
+}
+
+float BVH::compute_cost() const {
+	if (nodes.empty()) return 0.0f;
+	//expected number of node visits + item tests for a random ray that hits the root:
+	float root = surface_area(nodes[0].min, nodes[0].max);
+	if (root <= 0.0f) return 0.0f;
+	float total = 0.0f;
+	for (auto const &node : nodes) {
+		total += surface_area(node.min, node.max) * (node.count ? float(node.count) : 1.0f);
+	}
+	return total / root;
+}
+
+void BVH::query_planes(glm::vec4 const *planes, uint32_t plane_count, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+	if (nodes.empty()) return;
+
+	//classify a box as outside (-1), intersecting (0), or inside (1) the region:
+	auto classify = [&](glm::vec3 const &min, glm::vec3 const &max) -> int {
+		return classify_box(planes, plane_count, min, max);
+	};
+
+	//append every item below a node without testing:
+	auto append_all = [&](uint32_t n) {
+		std::vector< uint32_t > stack(1, n);
+		while (!stack.empty()) {
+			Node const &node = nodes[stack.back()];
+			stack.pop_back();
+			if (node.count) {
+				out.insert(out.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+			} else {
+				stack.emplace_back(node.first);
+				stack.emplace_back(node.first + 1);
+			}
+		}
+	};
+
+	std::vector< uint32_t > stack(1, 0);
+	while (!stack.empty()) {
+		uint32_t n = stack.back();
+		stack.pop_back();
+		Node const &node = nodes[n];
+		int c = classify(node.min, node.max);
+		if (c < 0) continue;
+		if (c > 0) {
+			append_all(n);
+		} else if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (classify(boxes[items[i]].min, boxes[items[i]].max) >= 0) out.emplace_back(items[i]);
+			}
+		} else {
+			stack.emplace_back(node.first + 1);
+			stack.emplace_back(node.first);
+		}
+	}
+}
+
+void BVH::query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+	if (nodes.empty()) return;
+
+	auto overlaps = [&](glm::vec3 const &bmin, glm::vec3 const &bmax) {
+		return bmin.x <= max.x && min.x <= bmax.x
+		    && bmin.y <= max.y && min.y <= bmax.y
+		    && bmin.z <= max.z && min.z <= bmax.z;
+	};
+
+	std::vector< uint32_t > stack(1, 0);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(boxes[items[i]].min, boxes[items[i]].max)) out.emplace_back(items[i]);
+			}
+		} else {
+			stack.emplace_back(node.first + 1);
+			stack.emplace_back(node.first);
+		}
+	}
+}
+
+uint32_t BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t_out) const {
+	if (nodes.empty()) return -1U;
+
+	//n.b. division by zero gives +/-infinity, which the slab test below handles:
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	//returns entry distance along ray, or infinity if the box is missed within [0,max_t]:
+	auto hit = [&](glm::vec3 const &min, glm::vec3 const &max) -> float {
+		glm::vec3 t0 = (min - origin) * inv_direction;
+		glm::vec3 t1 = (max - origin) * inv_direction;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	};
+
+	uint32_t best = -1U;
+	float best_t = std::numeric_limits< float >::infinity();
+
+	std::vector< uint32_t > stack(1, 0);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+		if (!(hit(node.min, node.max) < best_t)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t = hit(boxes[items[i]].min, boxes[items[i]].max);
+				if (t < best_t) {
+					best_t = t;
+					best = items[i];
+				}
+			}
+		} else {
+			//visit nearer child first so that farther child can (often) be skipped:
+			float t_left = hit(nodes[node.first].min, nodes[node.first].max);
+			float t_right = hit(nodes[node.first+1].min, nodes[node.first+1].max);
+			if (t_left < t_right) {
+				stack.emplace_back(node.first + 1);
+				stack.emplace_back(node.first);
+			} else {
+				stack.emplace_back(node.first);
+				stack.emplace_back(node.first + 1);
+			}
+		}
+	}
+
+	if (best != -1U && t_out) *t_out = best_t;
+	return best;
+}
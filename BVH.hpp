@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * A BVH is a bounding volume hierarchy over a set of axis-aligned boxes,
+ * used to quickly find the boxes that are inside a frustum, overlap a box,
+ * or are hit by a ray.
+ *
+ * Items are identified by their index in the array of boxes passed to build().
+ * When boxes move (but items aren't added or removed), refit() updates the
+ * hierarchy in linear time; since refitting doesn't change the tree structure,
+ * the tree gets worse as things move around -- check degraded() to decide
+ * when to build() again.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct BVH {
+	struct Box {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+	};
+
+	//build a new hierarchy over boxes:
+	void build(std::vector< Box > const &boxes);
+
+	//update the hierarchy for moved boxes:
+	// (boxes.size() must match the boxes passed to build())
+	void refit(std::vector< Box > const &boxes);
+
+	//has refitting made the tree much worse than a freshly-built one?
+	bool degraded() const { return cost > 2.0f * build_cost; }
+
+	//append indices of boxes that might be inside the (convex) region { p | dot(plane.xyz, p) + plane.w >= 0 for all planes }:
+	void query_planes(glm::vec4 const *planes, uint32_t plane_count, std::vector< uint32_t > *out) const;
+
+	//append indices of boxes that overlap [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *out) const;
+
+	//find the first box hit by the ray origin + t * direction, for t in [0,max_t]:
+	// returns -1U if nothing is hit; otherwise returns the index and (optionally) sets *t_out
+	uint32_t raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t_out = nullptr) const;
+
+	//-- internals ---
+
+	//nodes[0] is the root; children always come after their parents:
+	struct Node {
+		glm::vec3 min;
+		uint32_t first; //leaf: first entry in 'items'; internal: index of left child (right child is first+1)
+		glm::vec3 max;
+		uint32_t count; //leaf: number of items; internal: 0
+	};
+	std::vector< Node > nodes;
+	std::vector< uint32_t > items; //box indices, in leaf order
+	std::vector< Box > boxes; //copy of the most recent boxes passed to build() or refit()
+
+	//surface-area cost of the tree (relative to the root), at build time and currently:
+	float build_cost = 0.0f;
+	float cost = 0.0f;
+
+	float compute_cost() const;
+};
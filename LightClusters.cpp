@@ -0,0 +1,252 @@
+#include "LightClusters.hpp"
+
+#include "ThreadPool.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+GLuint LightClusters::empty_block_buffer = 0;
+
+LightClusters::LightClusters(glm::uvec3 const &size_) : size(size_) {
+	assert(size.x > 0 && size.y > 0 && size.z > 0);
+}
+
+LightClusters::~LightClusters() {
+	if (lights_buffer) {
+		GLuint buffers[4] = { lights_buffer, ranges_buffer, indices_buffer, block_buffer };
+		glDeleteBuffers(4, buffers);
+		GLuint textures[3] = { lights_texture, ranges_texture, indices_texture };
+		glDeleteTextures(3, textures);
+		if (empty_block_buffer) bind_empty(); //(in case block_buffer was the one bound)
+	}
+}
+
+//unit normals of the planes (through the eye) that separate 'count' tiles of clip space along one axis:
+// plane k has normalized device coordinate t = 2k/count - 1 along the axis; projection 'scale' maps view-space x/-z (or y/-z) to that coordinate
+// (a point v is on the positive side -- t < ndc -- when dot(normal, vec2(v.x or v.y, v.z)) > 0)
+static void tile_planes(uint32_t count, float scale, std::vector< glm::vec2 > *planes) {
+	planes->clear();
+	for (uint32_t k = 0; k <= count; ++k) {
+		float t = 2.0f * float(k) / float(count) - 1.0f;
+		planes->emplace_back(glm::normalize(glm::vec2(scale, t)));
+	}
+}
+
+//first and last tile that a sphere (center coordinate 'c' along the axis, depth coordinate 'z', radius 'r') might reach:
+// (tiles at the edges extend out to infinity, matching the shader's clamp)
+static void tile_range(std::vector< glm::vec2 > const &planes, float c, float z, float r, uint32_t *first, uint32_t *last) {
+	uint32_t count = uint32_t(planes.size()) - 1;
+	*first = 0;
+	while (*first + 1 < count && planes[*first + 1].x * c + planes[*first + 1].y * z > r) ++*first;
+	*last = count - 1;
+	while (*last > *first && planes[*last].x * c + planes[*last].y * z < -r) --*last;
+}
+
+void LightClusters::update(Scene const &scene, Scene::Camera const &camera, glm::mat4x3 const &world_to_light, ThreadPool *pool) {
+	assert(camera.transform);
+
+	//view space, as seen from light space (where shaders do their lighting):
+	glm::mat4 world_to_view = glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4 light_to_view = world_to_view * glm::inverse(glm::mat4(world_to_light));
+	glm::mat4 projection = camera.make_projection();
+
+	//fragments at depth d are in slice floor(log(d) * z_scale + z_bias):
+	float z_near = camera.near;
+	float z_scale = float(size.z) / std::log(std::max(max_depth, 2.0f * z_near) / z_near);
+	float z_bias = -std::log(z_near) * z_scale;
+	auto slice = [&](float d) -> uint32_t {
+		float s = std::floor(std::log(d) * z_scale + z_bias);
+		return uint32_t(std::max(0.0f, std::min(float(size.z - 1), s)));
+	};
+
+	for (uint32_t c = 0; c < 4; ++c) block.CLUSTER_LIGHT_TO_VIEW[c] = glm::vec4(glm::vec3(light_to_view[c]), 0.0f);
+	block.CLUSTER_SCALE = glm::vec4(projection[0][0], projection[1][1], z_scale, z_bias);
+
+	//Write light data, with lights that reach everywhere first:
+	lights.clear();
+	spheres.clear();
+	glm::mat3 direction_to_light = glm::mat3(world_to_light);
+	auto add_light = [&](Scene::Light const &light) {
+		glm::mat4x3 const &local_to_world = light.transform->make_local_to_world();
+		glm::vec3 location = world_to_light * glm::vec4(local_to_world[3], 1.0f);
+		glm::vec3 direction = glm::normalize(direction_to_light * -local_to_world[2]);
+
+		float type = 0.0f;
+		if (light.type == Scene::Light::Point) type = 0.0f;
+		else if (light.type == Scene::Light::Hemisphere) type = 1.0f;
+		else if (light.type == Scene::Light::Spot) type = 2.0f;
+		else if (light.type == Scene::Light::Directional) type = 3.0f;
+
+		lights.emplace_back(location, type);
+		lights.emplace_back(direction, std::cos(0.5f * light.spot_fov));
+		lights.emplace_back(light.energy, 0.0f);
+	};
+	for (auto const &light : scene.lights) {
+		if (light.type == Scene::Light::Hemisphere || light.type == Scene::Light::Directional) add_light(light);
+	}
+	global_lights = uint32_t(lights.size() / 3);
+	for (auto const &light : scene.lights) {
+		if (light.type == Scene::Light::Hemisphere || light.type == Scene::Light::Directional) continue;
+		add_light(light);
+		//energy falls off with squared distance, so the light's reach is:
+		float energy = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		float radius = std::sqrt(std::max(0.0f, energy) / min_energy);
+		glm::vec3 center = glm::vec3(light_to_view * glm::vec4(glm::vec3(lights[lights.size() - 3]), 1.0f));
+		spheres.emplace_back(center, radius);
+	}
+
+	block.CLUSTER_SIZE = glm::ivec4(size.x, size.y, size.z, global_lights);
+
+	//Find the box of clusters each light reaches:
+	tile_planes(size.x, projection[0][0], &x_planes);
+	tile_planes(size.y, projection[1][1], &y_planes);
+
+	reach.resize(spheres.size());
+	auto reach_range = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			glm::vec4 const &sphere = spheres[i];
+			Reach &r = reach[i];
+			float d_min = -sphere.z - sphere.w;
+			float d_max = -sphere.z + sphere.w;
+			if (d_max <= z_near) {
+				//entirely behind the near plane -- reaches no clusters:
+				r.min = glm::uvec3(1);
+				r.max = glm::uvec3(0);
+				continue;
+			}
+			r.min.z = slice(std::max(d_min, z_near));
+			r.max.z = slice(d_max);
+			tile_range(x_planes, sphere.x, sphere.z, sphere.w, &r.min.x, &r.max.x);
+			tile_range(y_planes, sphere.y, sphere.z, sphere.w, &r.min.y, &r.max.y);
+		}
+	};
+
+	//Fill in the clusters one depth slice at a time (so slices can be filled in parallel):
+	uint32_t slice_size = size.x * size.y;
+	ranges.assign(slice_size * size.z, glm::uvec2(0));
+	slice_indices.resize(size.z);
+	auto fill_slices = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t z = begin; z < end; ++z) {
+			glm::uvec2 *slice_ranges = ranges.data() + z * slice_size;
+
+			//count lights in each cluster:
+			for (Reach const &r : reach) {
+				if (z < r.min.z || z > r.max.z) continue;
+				for (uint32_t y = r.min.y; y <= r.max.y; ++y) {
+					for (uint32_t x = r.min.x; x <= r.max.x; ++x) {
+						slice_ranges[y * size.x + x].y += 1;
+					}
+				}
+			}
+
+			//allocate space for each cluster's list (counts are reset and re-counted while filling):
+			uint32_t total = 0;
+			for (uint32_t c = 0; c < slice_size; ++c) {
+				slice_ranges[c].x = total;
+				total += slice_ranges[c].y;
+				slice_ranges[c].y = 0;
+			}
+
+			//fill lists:
+			std::vector< uint32_t > &out = slice_indices[z];
+			out.resize(total);
+			for (uint32_t i = 0; i < uint32_t(reach.size()); ++i) {
+				Reach const &r = reach[i];
+				if (z < r.min.z || z > r.max.z) continue;
+				for (uint32_t y = r.min.y; y <= r.max.y; ++y) {
+					for (uint32_t x = r.min.x; x <= r.max.x; ++x) {
+						glm::uvec2 &range = slice_ranges[y * size.x + x];
+						out[range.x + range.y] = global_lights + i;
+						range.y += 1;
+					}
+				}
+			}
+		}
+	};
+
+	if (pool) {
+		pool->parallel_for(uint32_t(spheres.size()), reach_range, 64);
+		pool->parallel_for(size.z, fill_slices);
+	} else {
+		reach_range(0, uint32_t(spheres.size()));
+		fill_slices(0, size.z);
+	}
+
+	//Join the per-slice lists:
+	indices.clear();
+	for (uint32_t z = 0; z < size.z; ++z) {
+		uint32_t base = uint32_t(indices.size());
+		for (uint32_t c = z * slice_size; c < (z + 1) * slice_size; ++c) {
+			ranges[c].x += base;
+		}
+		indices.insert(indices.end(), slice_indices[z].begin(), slice_indices[z].end());
+	}
+}
+
+void LightClusters::upload() {
+	if (!lights_buffer) {
+		glGenBuffers(1, &lights_buffer);
+		glGenBuffers(1, &ranges_buffer);
+		glGenBuffers(1, &indices_buffer);
+		glGenBuffers(1, &block_buffer);
+
+		auto make_texture = [](GLuint buffer, GLenum format) {
+			GLuint texture = 0;
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_BUFFER, texture);
+			glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			return texture;
+		};
+		lights_texture = make_texture(lights_buffer, GL_RGBA32F);
+		ranges_texture = make_texture(ranges_buffer, GL_RG32UI);
+		indices_texture = make_texture(indices_buffer, GL_R32UI);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, lights_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, lights.size() * sizeof(glm::vec4), lights.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, ranges_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, ranges.size() * sizeof(glm::uvec2), ranges.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, indices_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void LightClusters::bind() const {
+	assert(lights_buffer && "upload() before bind()");
+
+	glActiveTexture(GL_TEXTURE0 + LightsUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, lights_texture);
+	glActiveTexture(GL_TEXTURE0 + RangesUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, ranges_texture);
+	glActiveTexture(GL_TEXTURE0 + IndicesUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, indices_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, ClustersBlockBinding, block_buffer);
+
+	GL_ERRORS();
+}
+
+void LightClusters::bind_empty() {
+	if (!empty_block_buffer) {
+		//CLUSTER_SIZE of zero means no clusters and no lights:
+		std::vector< uint8_t > zeros(sizeof(Block), 0);
+		glGenBuffers(1, &empty_block_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, empty_block_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, zeros.size(), zeros.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, ClustersBlockBinding, empty_block_buffer);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+ * LightClusters sorts a scene's lights into a grid of "clusters" covering
+ * the view frustum -- screen-space tiles in x and y, exponentially spaced
+ * depth slices in z -- so that shaders only need to loop over the lights
+ * that can actually reach each fragment.
+ *
+ * LightClusters clusters;
+ * //each frame:
+ * clusters.update(scene, camera);
+ * clusters.upload();
+ * clusters.bind();
+ * scene.draw(camera); //with programs that read the clusters (see GLSL below)
+ *
+ * Hemisphere and directional lights reach everywhere, so they are listed
+ * once (before all other lights) instead of in every cluster.
+ *
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ThreadPool;
+
+struct LightClusters {
+	//'size' is the number of clusters along x (screen columns), y (screen rows), and z (depth slices):
+	LightClusters(glm::uvec3 const &size = glm::uvec3(16, 9, 24));
+	~LightClusters();
+
+	//owns OpenGL objects, so copying is not allowed:
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	glm::uvec3 size;
+
+	//point and spot lights are treated as reaching only as far as their (brightest channel of) energy / distance^2 stays above this:
+	float min_energy = 1.0f / 256.0f;
+
+	//depth slices are spaced exponentially from the camera's near plane to this distance:
+	// (the last slice also covers everything beyond 'max_depth')
+	float max_depth = 100.0f;
+
+	//find the clusters reached by each of scene.lights, as seen from 'camera':
+	// world_to_light should match the one passed to Scene::draw (shaders light fragments in light space)
+	// if 'pool' is given, lights and depth slices are processed on its threads
+	// (makes no OpenGL calls)
+	void update(Scene const &scene, Scene::Camera const &camera, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f), ThreadPool *pool = nullptr);
+
+	//copy the results of update() to OpenGL buffers:
+	void upload();
+
+	//bind the buffers for drawing: buffer textures to units LightsUnit, RangesUnit, IndicesUnit and the Clusters block to ClustersBlockBinding:
+	// (the active texture unit is left as GL_TEXTURE0)
+	void bind() const;
+
+	//bind an empty Clusters block (no lights) to ClustersBlockBinding:
+	// programs that declare the block need some buffer bound there to draw at all, even with clustered lighting turned off
+	// (LitColorTextureProgram calls this when it loads; destroying a LightClusters calls it again, since deleting a bound buffer unbinds it)
+	static void bind_empty();
+
+	//texture units and uniform block binding used by bind():
+	// (units follow Scene::Drawable::Pipeline's textures and instance data)
+	enum : uint32_t {
+		LightsUnit = Scene::Drawable::Pipeline::InstanceDataUnit + 1,
+		RangesUnit,
+		IndicesUnit,
+		ClustersBlockBinding = Scene::Drawable::Pipeline::ObjectBlockBinding + 1,
+	};
+
+	//GLSL declarations for reading the clusters (for use in fragment shaders):
+	// program should set CLUSTER_LIGHTS, CLUSTER_RANGES, and CLUSTER_INDICES to the units above
+	// and bind its "Clusters" block to ClustersBlockBinding.
+	//  - lights 0 .. CLUSTER_SIZE.w-1 reach everywhere
+	//  - cluster_range(position) returns (first, count) of the entries in CLUSTER_INDICES for the lights that reach 'position'
+	//  - cluster_light(index, ...) fetches a light; 'type' matches LitColorTextureProgram's LIGHT_TYPE
+	static constexpr char const *GLSL =
+		"layout(std140) uniform Clusters {\n"
+		"	mat4x3 CLUSTER_LIGHT_TO_VIEW;\n"
+		"	vec4 CLUSTER_SCALE;\n" //projection x and y scale, depth slice scale and bias
+		"	ivec4 CLUSTER_SIZE;\n" //clusters along x, y, z; count of lights that reach everywhere
+		"};\n"
+		"uniform samplerBuffer CLUSTER_LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTER_RANGES;\n"
+		"uniform usamplerBuffer CLUSTER_INDICES;\n"
+		"uvec2 cluster_range(vec3 position) {\n"
+		"	vec3 v = CLUSTER_LIGHT_TO_VIEW * vec4(position, 1.0);\n"
+		"	float d = max(-v.z, 1e-6);\n"
+		"	vec2 ndc = v.xy / d * CLUSTER_SCALE.xy;\n"
+		"	ivec3 c = ivec3(ivec2(floor((0.5 * ndc + 0.5) * vec2(CLUSTER_SIZE.xy))), int(floor(log(d) * CLUSTER_SCALE.z + CLUSTER_SCALE.w)));\n"
+		"	c = clamp(c, ivec3(0), CLUSTER_SIZE.xyz - 1);\n"
+		"	return texelFetch(CLUSTER_RANGES, c.x + CLUSTER_SIZE.x * (c.y + CLUSTER_SIZE.y * c.z)).xy;\n"
+		"}\n"
+		"void cluster_light(int index, out int type, out vec3 location, out vec3 direction, out vec3 energy, out float cutoff) {\n"
+		"	vec4 a = texelFetch(CLUSTER_LIGHTS, 3 * index + 0);\n"
+		"	vec4 b = texelFetch(CLUSTER_LIGHTS, 3 * index + 1);\n"
+		"	vec4 c = texelFetch(CLUSTER_LIGHTS, 3 * index + 2);\n"
+		"	type = int(a.w);\n"
+		"	location = a.xyz;\n"
+		"	direction = b.xyz;\n"
+		"	cutoff = b.w;\n"
+		"	energy = c.rgb;\n"
+		"}\n";
+
+	//-- internals ---
+
+	//written by update():
+
+	//three texels per light: (location, type), (direction, cutoff), (energy, unused) -- all in light space:
+	std::vector< glm::vec4 > lights;
+	uint32_t global_lights = 0; //lights that reach everywhere (listed first in 'lights')
+
+	//(first, count) in 'indices' for each cluster, x-major then y then z:
+	std::vector< glm::uvec2 > ranges;
+	//indices into 'lights' (divided by three) for each cluster's lights:
+	std::vector< uint32_t > indices;
+
+	//contents of the Clusters uniform block, in std140 layout:
+	struct Block {
+		glm::vec4 CLUSTER_LIGHT_TO_VIEW[4]; //mat4x3 -- std140 pads each column to a vec4
+		glm::vec4 CLUSTER_SCALE;
+		glm::ivec4 CLUSTER_SIZE;
+	} block;
+	static_assert(sizeof(Block) == 64 + 16 + 16, "Block matches std140 layout.");
+
+	//scratch space for update():
+	std::vector< glm::vec4 > spheres; //view-space center and radius of each light that doesn't reach everywhere
+	std::vector< glm::vec2 > x_planes, y_planes; //unit normals (in the xz / yz plane) of the planes between columns / rows
+	struct Reach {
+		glm::uvec3 min; //first cluster reached
+		glm::uvec3 max; //last cluster reached
+	};
+	std::vector< Reach > reach;
+	std::vector< std::vector< uint32_t > > slice_indices;
+
+	//OpenGL objects (created by the first upload()):
+	GLuint lights_buffer = 0, lights_texture = 0;
+	GLuint ranges_buffer = 0, ranges_texture = 0;
+	GLuint indices_buffer = 0, indices_texture = 0;
+	GLuint block_buffer = 0;
+	static GLuint empty_block_buffer; //(created by the first bind_empty())
+};
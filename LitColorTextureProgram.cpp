@@ -11,17 +11,9 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	lit_color_texture_program_pipeline.uses_object_block = true;
+
+	lit_color_texture_program_pipeline.instanced_program = ret->instanced_program;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -44,17 +36,73 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 });
 
 LitColorTextureProgram::LitColorTextureProgram() {
+	//The lighting code is shared by both variants of the program:
+	// (attribute locations are fixed so that both variants can use the same vertex array objects)
+	std::string const fragment_shader =
+		std::string("#version 330\n")
+		+ LightClusters::GLSL
+		+ LightBlockGLSL +
+		"uniform sampler2D TEX;\n"
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec4 color;\n"
+		"in vec2 texCoord;\n"
+		"out vec4 fragColor;\n"
+		"vec3 light_energy(vec3 n, int type, vec3 location, vec3 direction, vec3 energy, float cutoff) {\n"
+		"	if (type == 0) { //point light \n"
+		"		vec3 l = (location - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		return nl * energy;\n"
+		"	} else if (type == 1) { //hemi light \n"
+		"		return (dot(n,-direction) * 0.5 + 0.5) * energy;\n"
+		"	} else if (type == 2) { //spot light \n"
+		"		vec3 l = (location - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		float c = dot(l,-direction);\n"
+		"		nl *= smoothstep(cutoff,mix(cutoff,1.0,0.1), c);\n"
+		"		return nl * energy;\n"
+		"	} else { //(type == 3) //directional light \n"
+		"		return max(0.0, dot(n,-direction)) * energy;\n"
+		"	}\n"
+		"}\n"
+		"vec3 cluster_light_energy(vec3 n, int index) {\n"
+		"	int type; vec3 location, direction, energy; float cutoff;\n"
+		"	cluster_light(index, type, location, direction, energy, cutoff);\n"
+		"	return light_energy(n, type, location, direction, energy, cutoff);\n"
+		"}\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 e;\n"
+		"	if (CLUSTERED_LIGHTS) { //lights that reach everywhere, then lights that reach this cluster \n"
+		"		e = vec3(0.0);\n"
+		"		for (int i = 0; i < CLUSTER_SIZE.w; ++i) {\n"
+		"			e += cluster_light_energy(n, i);\n"
+		"		}\n"
+		"		uvec2 range = cluster_range(position);\n"
+		"		for (uint i = range.x; i < range.x + range.y; ++i) {\n"
+		"			e += cluster_light_energy(n, int(texelFetch(CLUSTER_INDICES, int(i)).r));\n"
+		"		}\n"
+		"	} else {\n"
+		"		e = light_energy(n, LIGHT_TYPE, LIGHT_LOCATION, LIGHT_DIRECTION, LIGHT_ENERGY, LIGHT_CUTOFF);\n"
+		"	}\n"
+		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+		"}\n"
+	;
+
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+		std::string("#version 330\n")
+		+ Scene::Drawable::Pipeline::ObjectBlockGLSL +
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
@@ -68,46 +116,45 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"}\n"
 	,
 		//fragment shader:
+		fragment_shader
+	);
+	//As you can see above, adjacent strings in C/C++ are concatenated.
+	// this is very useful for writing long shader programs inline.
+
+	//The instanced variant fetches its matrices from INSTANCE_DATA (layout matches Scene::draw's instance buffer):
+	instanced_program = gl_compile_program(
+		//vertex shader:
 		"#version 330\n"
-		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
+		"uniform samplerBuffer INSTANCE_DATA;\n"
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
-		"	}\n"
-		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
-		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+		"	int base = gl_InstanceID * 11;\n"
+		"	mat4 OBJECT_TO_CLIP = mat4(\n"
+		"		texelFetch(INSTANCE_DATA, base+0), texelFetch(INSTANCE_DATA, base+1),\n"
+		"		texelFetch(INSTANCE_DATA, base+2), texelFetch(INSTANCE_DATA, base+3));\n"
+		"	mat4x3 OBJECT_TO_LIGHT = mat4x3(\n"
+		"		texelFetch(INSTANCE_DATA, base+4).xyz, texelFetch(INSTANCE_DATA, base+5).xyz,\n"
+		"		texelFetch(INSTANCE_DATA, base+6).xyz, texelFetch(INSTANCE_DATA, base+7).xyz);\n"
+		"	mat3 NORMAL_TO_LIGHT = mat3(\n"
+		"		texelFetch(INSTANCE_DATA, base+8).xyz, texelFetch(INSTANCE_DATA, base+9).xyz,\n"
+		"		texelFetch(INSTANCE_DATA, base+10).xyz);\n"
+		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"	position = OBJECT_TO_LIGHT * Position;\n"
+		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
 		"}\n"
+	,
+		//fragment shader:
+		fragment_shader
 	);
-	//As you can see above, adjacent strings in C/C++ are concatenated.
-	// this is very useful for writing long shader programs inline.
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
@@ -115,16 +162,8 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	//per-drawable matrices come from the buffer range Scene::draw binds to ObjectBlockBinding:
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Object"), Scene::Drawable::Pipeline::ObjectBlockBinding);
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
@@ -135,10 +174,48 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+
+	//same for the instanced variant, which also needs to know where its instance data is:
+	glUseProgram(instanced_program);
+	glUniform1i(glGetUniformLocation(instanced_program, "TEX"), 0);
+	glUniform1i(glGetUniformLocation(instanced_program, "INSTANCE_DATA"), Scene::Drawable::Pipeline::InstanceDataUnit);
+	glUseProgram(0);
+
+	//both variants read lighting parameters from the Light block, and clustered lights from the buffers LightClusters::bind() binds:
+	for (GLuint p : { program, instanced_program }) {
+		glUniformBlockBinding(p, glGetUniformBlockIndex(p, "Light"), LightBlockBinding);
+		glUniformBlockBinding(p, glGetUniformBlockIndex(p, "Clusters"), LightClusters::ClustersBlockBinding);
+		glUseProgram(p);
+		glUniform1i(glGetUniformLocation(p, "CLUSTER_LIGHTS"), LightClusters::LightsUnit);
+		glUniform1i(glGetUniformLocation(p, "CLUSTER_RANGES"), LightClusters::RangesUnit);
+		glUniform1i(glGetUniformLocation(p, "CLUSTER_INDICES"), LightClusters::IndicesUnit);
+		glUseProgram(0);
+	}
+
+	//..but the block needs a buffer even when CLUSTERED_LIGHTS is off, so start with an empty one:
+	LightClusters::bind_empty();
+
+	//start unlit, as the plain uniforms used to:
+	glGenBuffers(1, &light_buffer);
+	set_light(LightBlock());
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
 	glDeleteProgram(program);
 	program = 0;
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
+	glDeleteBuffers(1, &light_buffer);
+	light_buffer = 0;
+}
+
+void LitColorTextureProgram::set_light(LightBlock const &light) const {
+	glBindBuffer(GL_UNIFORM_BUFFER, light_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), &light, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightBlockBinding, light_buffer);
+
+	GL_ERRORS();
 }
 
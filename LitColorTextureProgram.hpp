@@ -3,6 +3,7 @@
 #include "GL.hpp"
 #include "Load.hpp"
 #include "Scene.hpp"
+#include "LightClusters.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
@@ -17,24 +18,64 @@ struct LitColorTextureProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//Uniform block (per-drawable matrices) -- declared as Scene::Drawable::Pipeline::ObjectBlockGLSL:
+	//'Object' - bound to Scene::Drawable::Pipeline::ObjectBlockBinding
+
+	//Uniform block (lighting) -- shared by 'program' and 'instanced_program', so one set_light() covers both:
+	//'Light' - bound to LightBlockBinding
+	enum : uint32_t { LightBlockBinding = LightClusters::ClustersBlockBinding + 1 };
+	struct LightBlock {
+		int32_t LIGHT_TYPE = 0; //0: point, 1: hemi, 2: spot, 3: directional
+		uint32_t pad0[3] = { 0, 0, 0 };
+		glm::vec3 LIGHT_LOCATION = glm::vec3(0.0f);
+		float pad1 = 0.0f;
+		glm::vec3 LIGHT_DIRECTION = glm::vec3(0.0f, 0.0f, -1.0f);
+		float pad2 = 0.0f;
+		glm::vec3 LIGHT_ENERGY = glm::vec3(0.0f);
+		float LIGHT_CUTOFF = 1.0f; //(packs into the end of LIGHT_ENERGY's vec4, as std140 does)
+		//..or, if CLUSTERED_LIGHTS is set, use all lights from a LightClusters (LIGHT_* above are ignored):
+		uint32_t CLUSTERED_LIGHTS = 0; //(a GLSL bool is four bytes)
+		uint32_t pad3[3] = { 0, 0, 0 };
+	};
+	static_assert(sizeof(LightBlock) == 16 + 16 + 16 + 16 + 16, "LightBlock matches std140 layout.");
+	static constexpr char const *LightBlockGLSL =
+		"layout(std140) uniform Light {\n"
+		"	int LIGHT_TYPE;\n"
+		"	vec3 LIGHT_LOCATION;\n"
+		"	vec3 LIGHT_DIRECTION;\n"
+		"	vec3 LIGHT_ENERGY;\n"
+		"	float LIGHT_CUTOFF;\n"
+		"	bool CLUSTERED_LIGHTS;\n"
+		"};\n";
+
+	//upload new lighting parameters (and bind the block to LightBlockBinding, in case something else was bound there):
+	// (the constructor does this with a default LightBlock, which leaves everything unlit)
+	void set_light(LightBlock const &light) const;
+	GLuint light_buffer = 0;
+
+	//Uniform block (clustered lights) -- declared as LightClusters::GLSL:
+	//'Clusters' - bound to LightClusters::ClustersBlockBinding
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE0 + LightClusters::LightsUnit, RangesUnit, IndicesUnit - buffer textures with clustered lights (see LightClusters::bind())
+
+	//Instanced variant of 'program':
+	// reads OBJECT_TO_CLIP, OBJECT_TO_LIGHT, and NORMAL_TO_LIGHT for each instance from a buffer texture
+	// (Scene::draw uses this to draw many drawables that share a mesh in one call)
+	// uses the same attribute locations as 'program', so vaos made for one work with the other
+	// (lighting comes from the same 'Light' block as 'program', so there is nothing extra to set)
+	GLuint instanced_program = 0;
+
+	//Textures (instanced_program):
+	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE0 + Scene::Drawable::Pipeline::InstanceDataUnit - buffer texture with per-instance matrices
+	//(clustered lights as above)
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// (includes instanced_program, so copies of a mesh are drawn with one call)
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
@@ -0,0 +1,306 @@
+#include "LooseOctree.hpp"
+
+#include "frustum_planes.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+//cell keys pack the level (5 bits) and x,y,z coordinates (19 bits each, offset so they are non-negative):
+static constexpr uint32_t CoordBits = 19;
+static constexpr int32_t CoordBias = 1 << (CoordBits - 1);
+static constexpr uint64_t CoordMask = (uint64_t(1) << CoordBits) - 1;
+
+static inline uint32_t key_level(uint64_t key) {
+	return uint32_t(key >> (3 * CoordBits));
+}
+
+static inline glm::ivec3 key_coord(uint64_t key) {
+	return glm::ivec3(
+		int32_t((key >> (2 * CoordBits)) & CoordMask) - CoordBias,
+		int32_t((key >> CoordBits) & CoordMask) - CoordBias,
+		int32_t(key & CoordMask) - CoordBias
+	);
+}
+
+//floor(c / 2), for negative c as well:
+static inline int32_t half_floor(int32_t c) {
+	return (c < 0 ? -((-c + 1) / 2) : c / 2);
+}
+
+//which child (0-7) of its parent a cell is:
+static inline uint32_t child_index(glm::ivec3 const &coord) {
+	return uint32_t(coord.x & 1) | (uint32_t(coord.y & 1) << 1) | (uint32_t(coord.z & 1) << 2);
+}
+
+LooseOctree::LooseOctree(float root_size_, uint32_t levels_) : root_size(root_size_), levels(levels_) {
+	if (!(root_size > 0.0f)) throw std::runtime_error("LooseOctree root size must be positive.");
+	if (levels < 1 || levels > 31) throw std::runtime_error("LooseOctree must have between 1 and 31 levels.");
+}
+
+uint64_t LooseOctree::make_key(uint32_t level, glm::ivec3 const &coord) const {
+	return (uint64_t(level) << (3 * CoordBits))
+	     | (uint64_t(uint32_t(coord.x + CoordBias) & CoordMask) << (2 * CoordBits))
+	     | (uint64_t(uint32_t(coord.y + CoordBias) & CoordMask) << CoordBits)
+	     | (uint64_t(uint32_t(coord.z + CoordBias) & CoordMask));
+}
+
+uint64_t LooseOctree::parent_key(uint64_t key) const {
+	uint32_t level = key_level(key);
+	assert(level > 0);
+	glm::ivec3 coord = key_coord(key);
+	return make_key(level - 1, glm::ivec3(half_floor(coord.x), half_floor(coord.y), half_floor(coord.z)));
+}
+
+uint64_t LooseOctree::child_key(uint64_t key, uint32_t child) const {
+	glm::ivec3 coord = key_coord(key);
+	return make_key(key_level(key) + 1, glm::ivec3(
+		2 * coord.x + int32_t(child & 1),
+		2 * coord.y + int32_t((child >> 1) & 1),
+		2 * coord.z + int32_t((child >> 2) & 1)
+	));
+}
+
+void LooseOctree::cell_bounds(uint64_t key, glm::vec3 *min, glm::vec3 *max) const {
+	float size = std::ldexp(root_size, -int32_t(key_level(key)));
+	glm::vec3 corner = glm::vec3(key_coord(key)) * size;
+	//loose bounds extend half a cell past the cell on every side:
+	*min = corner - glm::vec3(0.5f * size);
+	*max = corner + glm::vec3(1.5f * size);
+}
+
+uint64_t LooseOctree::choose_cell(glm::vec3 const &min, glm::vec3 const &max) const {
+	glm::vec3 extent = max - min;
+	float largest = std::max(extent.x, std::max(extent.y, extent.z));
+	glm::vec3 center = 0.5f * (min + max);
+	//(also catches NaN bounds:)
+	if (!(largest <= root_size) || !(glm::all(glm::lessThanEqual(min, max)))) return OversizedCell;
+
+	//the deepest level with cells at least as big as the item fits it (since the item's center is in the cell):
+	uint32_t level = levels - 1;
+	float size = std::ldexp(root_size, -int32_t(level));
+	while (size < largest) {
+		--level;
+		size *= 2.0f;
+	}
+
+	//...but if the item is too far out for that level's coordinates, go up to larger cells:
+	while (true) {
+		glm::vec3 coord = glm::floor(center / size);
+		if (glm::all(glm::greaterThanEqual(coord, glm::vec3(-float(CoordBias))))
+		 && glm::all(glm::lessThan(coord, glm::vec3(float(CoordBias))))) {
+			return make_key(level, glm::ivec3(coord));
+		}
+		if (level == 0) return OversizedCell;
+		--level;
+		size *= 2.0f;
+	}
+}
+
+void LooseOctree::add_to_cell(uint32_t item, uint64_t key) {
+	Cell &cell = cells[key];
+	items[item].cell = key;
+	items[item].index = uint32_t(cell.items.size());
+	cell.items.emplace_back(item);
+	cell.total += 1;
+	if (key == OversizedCell) return;
+
+	//make sure the path to the root exists and knows about the new item:
+	// (cell references stay valid as the table grows, since unordered_map doesn't move its elements)
+	Cell *at = &cell;
+	uint64_t at_key = key;
+	while (key_level(at_key) > 0) {
+		uint64_t up_key = parent_key(at_key);
+		Cell &up = cells[up_key];
+		up.children |= uint8_t(1 << child_index(key_coord(at_key)));
+		up.total += 1;
+		at = &up;
+		at_key = up_key;
+	}
+	if (at->root_index == -1U) {
+		at->root_index = uint32_t(roots.size());
+		roots.emplace_back(at_key);
+	}
+}
+
+void LooseOctree::remove_from_cell(uint32_t item) {
+	uint64_t key = items[item].cell;
+	assert(key != NoCell);
+	auto f = cells.find(key);
+	assert(f != cells.end());
+
+	//swap-remove from the cell's item list:
+	Cell &cell = f->second;
+	uint32_t index = items[item].index;
+	assert(cell.items[index] == item);
+	cell.items[index] = cell.items.back();
+	items[cell.items[index]].index = index;
+	cell.items.pop_back();
+	items[item].cell = NoCell;
+
+	//update counts on the path to the root, removing cells that are now empty:
+	while (true) {
+		Cell &at = f->second;
+		at.total -= 1;
+		bool empty = (at.total == 0);
+		if (empty) {
+			assert(at.items.empty() && at.children == 0);
+			if (at.root_index != -1U) {
+				roots[at.root_index] = roots.back();
+				cells.at(roots.back()).root_index = at.root_index;
+				roots.pop_back();
+			}
+			cells.erase(f);
+		}
+		if (key == OversizedCell || key_level(key) == 0) break;
+		uint64_t up_key = parent_key(key);
+		f = cells.find(up_key);
+		assert(f != cells.end());
+		if (empty) f->second.children &= uint8_t(~(1 << child_index(key_coord(key))));
+		key = up_key;
+	}
+}
+
+void LooseOctree::insert(uint32_t item, glm::vec3 const &min, glm::vec3 const &max) {
+	if (item >= items.size()) items.resize(item + 1);
+	if (items[item].cell != NoCell) throw std::runtime_error("Item " + std::to_string(item) + " is already in the octree.");
+	items[item].min = min;
+	items[item].max = max;
+	add_to_cell(item, choose_cell(min, max));
+	item_count += 1;
+}
+
+void LooseOctree::update(uint32_t item, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!contains(item)) throw std::runtime_error("Item " + std::to_string(item) + " is not in the octree.");
+	items[item].min = min;
+	items[item].max = max;
+	uint64_t key = choose_cell(min, max);
+	if (key == items[item].cell) return; //(the usual case for small movements)
+	remove_from_cell(item);
+	add_to_cell(item, key);
+}
+
+void LooseOctree::remove(uint32_t item) {
+	if (!contains(item)) throw std::runtime_error("Item " + std::to_string(item) + " is not in the octree.");
+	remove_from_cell(item);
+	item_count -= 1;
+}
+
+template< typename Classify, typename Visit >
+void LooseOctree::visit(Classify const &classify, Visit const &visit_items, glm::vec3 const *region_min, glm::vec3 const *region_max) const {
+	//oversized items aren't in the hierarchy, so always check them:
+	auto f = cells.find(OversizedCell);
+	if (f != cells.end()) visit_items(f->second, false);
+
+	struct Todo {
+		uint64_t key;
+		bool inside; //is the cell known to be entirely inside the region?
+	};
+	std::vector< Todo > todo;
+	todo.reserve(roots.size() + 64);
+
+	//top-level cells whose loose bounds [c * size - size/2, c * size + 1.5 size] might overlap the region:
+	bool pushed_roots = false;
+	if (region_min && region_max) {
+		glm::vec3 lo = glm::ceil((*region_min - glm::vec3(1.5f * root_size)) / root_size);
+		glm::vec3 hi = glm::floor((*region_max + glm::vec3(0.5f * root_size)) / root_size);
+		//(cells outside the key's coordinate range can't exist)
+		lo = glm::max(lo, glm::vec3(-float(CoordBias)));
+		hi = glm::min(hi, glm::vec3(float(CoordBias - 1)));
+		glm::vec3 range = glm::max(hi - lo + glm::vec3(1.0f), glm::vec3(0.0f));
+		//(only worth it if there are fewer such cells than there are top-level cells)
+		if (range.x * range.y * range.z < float(roots.size())) {
+			glm::ivec3 l = glm::ivec3(lo);
+			glm::ivec3 h = glm::ivec3(hi);
+			for (int32_t z = l.z; z <= h.z; ++z) {
+				for (int32_t y = l.y; y <= h.y; ++y) {
+					for (int32_t x = l.x; x <= h.x; ++x) {
+						uint64_t key = make_key(0, glm::ivec3(x, y, z));
+						if (cells.count(key)) todo.emplace_back(Todo{key, false});
+					}
+				}
+			}
+			pushed_roots = true;
+		}
+	}
+	if (!pushed_roots) {
+		for (uint64_t root : roots) {
+			todo.emplace_back(Todo{root, false});
+		}
+	}
+	while (!todo.empty()) {
+		Todo at = todo.back();
+		todo.pop_back();
+
+		bool inside = at.inside;
+		if (!inside) {
+			glm::vec3 min, max;
+			cell_bounds(at.key, &min, &max);
+			int c = classify(min, max);
+			if (c < 0) continue;
+			inside = (c > 0);
+		}
+
+		Cell const &cell = cells.at(at.key);
+		if (!cell.items.empty()) visit_items(cell, inside);
+		for (uint32_t child = 0; child < 8; ++child) {
+			if (cell.children & (1 << child)) todo.emplace_back(Todo{child_key(at.key, child), inside});
+		}
+	}
+}
+
+void LooseOctree::query_planes(glm::vec4 const *planes, uint32_t plane_count, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+
+	//classify a box as outside (-1), intersecting (0), or inside (1) the region:
+	auto classify = [&](glm::vec3 const &min, glm::vec3 const &max) -> int {
+		return classify_box(planes, plane_count, min, max);
+	};
+
+	visit(classify, [&](Cell const &cell, bool inside) {
+		for (uint32_t i : cell.items) {
+			if (inside || classify(items[i].min, items[i].max) >= 0) out.emplace_back(i);
+		}
+	});
+}
+
+void LooseOctree::query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+
+	auto classify = [&](glm::vec3 const &bmin, glm::vec3 const &bmax) -> int {
+		if (glm::any(glm::lessThan(bmax, min)) || glm::any(glm::greaterThan(bmin, max))) return -1;
+		if (glm::all(glm::lessThanEqual(min, bmin)) && glm::all(glm::lessThanEqual(bmax, max))) return 1;
+		return 0;
+	};
+
+	visit(classify, [&](Cell const &cell, bool inside) {
+		for (uint32_t i : cell.items) {
+			if (inside || classify(items[i].min, items[i].max) >= 0) out.emplace_back(i);
+		}
+	}, &min, &max);
+}
+
+void LooseOctree::query_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+
+	float radius2 = radius * radius;
+	auto classify = [&](glm::vec3 const &bmin, glm::vec3 const &bmax) -> int {
+		glm::vec3 closest = glm::clamp(center, bmin, bmax);
+		glm::vec3 to_closest = closest - center;
+		if (glm::dot(to_closest, to_closest) > radius2) return -1;
+		glm::vec3 farthest = glm::max(glm::abs(bmin - center), glm::abs(bmax - center));
+		if (glm::dot(farthest, farthest) <= radius2) return 1;
+		return 0;
+	};
+
+	glm::vec3 region_min = center - glm::vec3(radius);
+	glm::vec3 region_max = center + glm::vec3(radius);
+	visit(classify, [&](Cell const &cell, bool inside) {
+		for (uint32_t i : cell.items) {
+			if (inside || classify(items[i].min, items[i].max) >= 0) out.emplace_back(i);
+		}
+	}, &region_min, &region_max);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * A LooseOctree sorts axis-aligned boxes into a hierarchy of cubic cells,
+ * for quickly finding the boxes that overlap a sphere, a box, or a frustum.
+ *
+ * Unlike the BVH, items can be inserted, moved, and removed one at a time:
+ * each item lives in a single cell chosen from its center and size, and
+ * cells are "loose" (their bounds are twice their size), so an item that
+ * moves a little usually stays in the same cell. Moving to a new cell only
+ * touches the cells along the path to the root, so the cost of update()
+ * doesn't depend on how many items there are.
+ *
+ * Cells are stored in a hash table (keyed by level and coordinates), so
+ * there is no fixed world size and empty space costs nothing.
+ *
+ * Items are identified by uint32_t ids chosen by the caller (ids are used
+ * as indices into an internal array, so keep them small and dense).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct LooseOctree {
+	//cells at the top level have size 'root_size'; each further level halves the size:
+	LooseOctree(float root_size = 256.0f, uint32_t levels = 10);
+
+	//add an item with bounds [min,max] (item must not already be present):
+	void insert(uint32_t item, glm::vec3 const &min, glm::vec3 const &max);
+	//change the bounds of an item that is present:
+	void update(uint32_t item, glm::vec3 const &min, glm::vec3 const &max);
+	//remove an item that is present:
+	void remove(uint32_t item);
+
+	bool contains(uint32_t item) const { return item < items.size() && items[item].cell != NoCell; }
+	uint32_t size() const { return item_count; }
+
+	//append ids of items whose bounds might be inside the (convex) region { p | dot(plane.xyz, p) + plane.w >= 0 for all planes }:
+	void query_planes(glm::vec4 const *planes, uint32_t plane_count, std::vector< uint32_t > *out) const;
+
+	//append ids of items whose bounds overlap [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *out) const;
+
+	//append ids of items whose bounds overlap the sphere:
+	void query_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *out) const;
+
+	//-- internals ---
+	float root_size;
+	uint32_t levels;
+
+	//cells are keyed by level (high bits) and x,y,z cell coordinates:
+	static constexpr uint64_t NoCell = ~uint64_t(0);
+	static constexpr uint64_t OversizedCell = ~uint64_t(0) - 1; //holds items too big for any cell
+	uint64_t make_key(uint32_t level, glm::ivec3 const &coord) const;
+	uint64_t parent_key(uint64_t key) const;
+	uint64_t child_key(uint64_t key, uint32_t child) const;
+	void cell_bounds(uint64_t key, glm::vec3 *min, glm::vec3 *max) const; //loose bounds
+	uint64_t choose_cell(glm::vec3 const &min, glm::vec3 const &max) const;
+
+	struct Cell {
+		std::vector< uint32_t > items; //items stored in this cell
+		uint32_t total = 0; //items in this cell and all cells below it
+		uint8_t children = 0; //bit c set if child c has items (in it or below it)
+		uint32_t root_index = -1U; //index in 'roots' (top level cells only)
+	};
+	std::unordered_map< uint64_t, Cell > cells;
+	std::vector< uint64_t > roots; //keys of top-level cells
+
+	struct Item {
+		uint64_t cell = NoCell;
+		uint32_t index = 0; //index in cell.items
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+	};
+	std::vector< Item > items;
+	uint32_t item_count = 0;
+
+	void add_to_cell(uint32_t item, uint64_t key);
+	void remove_from_cell(uint32_t item);
+
+	//call visit_items(cell, inside) on every cell whose loose bounds might overlap a region:
+	// classify(min, max) returns -1 (box outside region), 0 (partially inside), or 1 (inside)
+	// if the region is bounded, passing its bounds lets visit() look up top-level cells directly instead of checking all of them
+	template< typename Classify, typename Visit >
+	void visit(Classify const &classify, Visit const &visit_items, glm::vec3 const *region_min = nullptr, glm::vec3 const *region_max = nullptr) const;
+};
@@ -152,7 +152,14 @@ const common_names = [
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('BVH.cpp'),
+	maek.CPP('LooseOctree.cpp'),
+	maek.CPP('ThreadPool.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('Name.cpp'),
+	maek.CPP('LightClusters.cpp'),
 	maek.CPP('Mesh.cpp'),
+	maek.CPP('MeshFile.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
@@ -166,12 +173,24 @@ const show_meshes_names = [
 	maek.CPP('ShowMeshesMode.cpp')
 ];
 
+const simplify_meshes_names = [
+	maek.CPP('simplify-meshes.cpp')
+];
+
 const show_scene_names = [
 	maek.CPP('show-scene.cpp'),
 	maek.CPP('ShowSceneProgram.cpp'),
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const upgrade_scene_names = [
+	maek.CPP('upgrade-scene.cpp')
+];
+
+const convert_meshes_names = [
+	maek.CPP('convert-meshes.cpp')
+];
+
 const freetype_test_names = [
 	maek.CPP('freetype-test.cpp')
 ];
@@ -182,12 +201,15 @@ const freetype_test_names = [
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
+const simplify_meshes_exe = maek.LINK([...simplify_meshes_names, ...common_names], 'scenes/simplify-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const upgrade_scene_exe = maek.LINK([...upgrade_scene_names, ...common_names], 'scenes/upgrade-scene');
+const convert_meshes_exe = maek.LINK([...convert_meshes_names, ...common_names], 'scenes/convert-meshes');
 
 const freetype_test_exe = maek.LINK([...freetype_test_names], 'freetype-test');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, freetype_test_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, simplify_meshes_exe, show_scene_exe, upgrade_scene_exe, convert_meshes_exe, freetype_test_exe, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
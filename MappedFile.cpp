@@ -0,0 +1,98 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename) {
+	#if defined(_WIN32)
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	file = handle;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(handle, &file_size)) {
+		CloseHandle(handle);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size == 0) return; //(can't map empty files)
+
+	mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(handle);
+		throw std::runtime_error("Failed to create mapping of '" + filename + "'.");
+	}
+	data = static_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	#else
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(info.st_size);
+	if (size == 0) return; //(can't map empty files)
+
+	void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	data = static_cast< char const * >(addr);
+	#endif
+}
+
+MappedFile::~MappedFile() {
+	#if defined(_WIN32)
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	#else
+	if (data) munmap(const_cast< char * >(data), size);
+	if (fd != -1) close(fd);
+	#endif
+}
+
+//-------------------------
+
+MemoryStreambuf::MemoryStreambuf(char const *begin_, char const *end_) {
+	//streambuf wants non-const pointers, but nothing here writes through them:
+	char *b = const_cast< char * >(begin_);
+	char *e = const_cast< char * >(end_);
+	setg(b, b, e);
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+	if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+	char *base = eback();
+	if (dir == std::ios_base::cur) base = gptr();
+	else if (dir == std::ios_base::end) base = egptr();
+	if (base + off < eback() || base + off > egptr()) return pos_type(off_type(-1));
+	setg(eback(), base + off, egptr());
+	return pos_type(gptr() - eback());
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
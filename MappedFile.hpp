@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file into (read-only) memory, so that it can be
+ * parsed in place instead of being copied into buffers first:
+ *
+ * MappedFile file(data_path("level.scene"));
+ * //... use file.data[0] through file.data[file.size-1] ...
+ *
+ * The mapping stays valid until the MappedFile is destroyed.
+ *
+ */
+
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+struct MappedFile {
+	//map 'filename' (throws on failure):
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//the mapping belongs to this object, so copying isn't allowed:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//-- internals ---
+	#if defined(_WIN32)
+	void *file = nullptr; //HANDLE
+	void *mapping = nullptr; //HANDLE
+	#else
+	int fd = -1;
+	#endif
+};
+
+//read-only std::streambuf over a range of memory (doesn't copy the memory):
+struct MemoryStreambuf : std::streambuf {
+	MemoryStreambuf(char const *begin_, char const *end_);
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+
+//...and a std::istream using it, for code that wants to read with streams:
+struct MemoryStream : private MemoryStreambuf, public std::istream {
+	MemoryStream(char const *begin_, char const *end_) : MemoryStreambuf(begin_, end_), std::istream(static_cast< MemoryStreambuf * >(this)) { }
+};
@@ -1,109 +1,168 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "MeshFile.hpp"
+#include "ThreadPool.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
-
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint total = 0;
-
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
-
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+//find the slot for a name with the given hash -- the one holding the mesh for which 'matches(index)' is true, or else the empty slot where that mesh would go:
+// (slots.size() is a power of two, and at least one slot is always empty)
+template< typename Matches >
+static size_t probe(std::vector< MeshBuffer::Slot > const &slots, size_t hash, Matches const &matches) {
+	size_t mask = slots.size() - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		MeshBuffer::Slot const &slot = slots[i];
+		if (slot.index == -1U || (slot.hash == hash && matches(slot.index))) return i;
+	}
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+MeshBuffer::MeshBuffer(std::string const &filename, bool upload_now, bool optimize) {
+	//read (and check) the file's contents:
+	MeshFile file(filename);
+	if (optimize) file.optimize();
 
-		total = GLuint(data.size()); //store total for later checks on index
+	//mesh bounds are stored in the file, or else computed here (using every core for big files, where this can take a while):
+	if (!file.bounds) {
+		constexpr size_t ParallelBoundsElements = 1 << 20; //(smaller files aren't worth handing to the thread pool)
+		size_t elements = (file.indexed ? file.indices.size() : file.vertices.size());
+		file.compute_bounds(elements >= ParallelBoundsElements ? &ThreadPool::shared() : nullptr);
+	}
 
-		//store attrib locations:
+	//store attrib locations:
+	if (file.quantized) {
+		using Vertex = MeshFile::QuantizedVertex;
+		Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	} else {
+		using Vertex = MeshFile::Vertex;
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
 		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
 		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
-		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
-
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
-
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
-
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
-			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-				throw std::runtime_error("index entry has out-of-range vertex start/count");
-			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
-			}
+	if (file.indexed) {
+		index_type = (file.small_indices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+	}
+
+	//add meshes (and a hash table -- at most half full -- to find them by name):
+	{
+		size_t size = 2;
+		while (size < 2 * file.meshes.size()) size *= 2;
+		slots.assign(size, Slot());
+	}
+	meshes.reserve(file.meshes.size());
+	mesh_names.reserve(file.meshes.size());
+	for (auto const &entry : file.meshes) {
+		Name name(entry.name);
+		Slot &slot = slots[probe(slots, name.hash(), [&](uint32_t index){ return mesh_names[index] == name; })];
+		if (slot.index != -1U) {
+			std::cerr << "WARNING: mesh name '" + entry.name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			continue;
+		}
+		slot.hash = name.hash();
+		slot.index = uint32_t(meshes.size());
+
+		Mesh mesh;
+		mesh.type = GL_TRIANGLES;
+		mesh.start = entry.begin;
+		mesh.count = entry.end - entry.begin;
+		mesh.index_type = index_type;
+		if (file.quantized) {
+			mesh.position_offset = entry.position_offset;
+			mesh.position_scale = entry.position_scale;
 		}
+		mesh.min = entry.min;
+		mesh.max = entry.max;
+		meshes.emplace_back(mesh);
+		mesh_names.emplace_back(name);
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	//keep data around for upload() (the file is done with it, so take it instead of copying):
+	if (file.quantized) {
+		//(vertices as read from the file, unless optimizing changed them)
+		if (file.packed.size() == file.vertices.size()) quantized_vertex_data = std::move(file.packed);
+		else quantized_vertex_data = file.quantized_vertices();
+	} else {
+		vertex_data = std::move(file.vertices);
+	}
+	if (index_type == GL_UNSIGNED_SHORT) {
+		small_index_data.assign(file.indices.begin(), file.indices.end());
+	} else if (index_type == GL_UNSIGNED_INT) {
+		index_data = std::move(file.indices);
 	}
+	if (upload_now) upload();
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		if (i + 1 == meshes.size() && meshes.size() > 1) std::cout << " and";
+		std::cout << " '" << mesh_names[i].str() << "'";
+		if (i + 1 != meshes.size()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
+void MeshBuffer::upload() {
+	if (buffer == 0) glGenBuffers(1, &buffer);
+
+	//copy a vector's contents to whatever is bound to GL_ARRAY_BUFFER, then free it (no need to keep a copy around once it's uploaded):
+	auto upload_and_free = [](auto &data) {
+		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(data[0]), data.data(), GL_STATIC_DRAW);
+		data.clear();
+		data.shrink_to_fit();
+	};
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (!quantized_vertex_data.empty()) upload_and_free(quantized_vertex_data);
+	else upload_and_free(vertex_data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (index_type != GL_NONE) {
+		if (index_buffer == 0) glGenBuffers(1, &index_buffer);
+
+		//(filled through GL_ARRAY_BUFFER, since the element array binding would change whatever vertex array object is bound)
+		glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+		if (index_type == GL_UNSIGNED_SHORT) upload_and_free(small_index_data);
+		else upload_and_free(index_data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+	MeshHandle found = handle(name);
+	if (!found) {
 		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
 	}
-	return f->second;
+	return meshes[found.index];
+}
+
+const Mesh *MeshBuffer::find(std::string const &name) const {
+	MeshHandle found = handle(name);
+	if (!found) return nullptr;
+	return &meshes[found.index];
+}
+
+MeshHandle MeshBuffer::handle(std::string_view const &name) const {
+	MeshHandle ret;
+	ret.index = slots[probe(slots, size_t(Name::hash_string(name)), [&](uint32_t index){ return mesh_names[index] == name; })].index;
+	return ret;
+}
+
+MeshHandle MeshBuffer::handle(Name const &name) const {
+	//(names are interned, so comparing them is just comparing pointers)
+	MeshHandle ret;
+	ret.index = slots[probe(slots, name.hash(), [&](uint32_t index){ return mesh_names[index] == name; })].index;
+	return ret;
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
@@ -128,6 +187,8 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(the element array binding is part of the vertex array object's state, so it is left bound)
+	if (index_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
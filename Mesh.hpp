@@ -6,22 +6,36 @@
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
+ * Code that looks up the same mesh repeatedly can resolve its name once with
+ *  MeshBuffer::handle() and keep the returned MeshHandle instead.
+ * If the file is indexed (see MeshFile.hpp), meshes are instead ranges of
+ *  an element array buffer, which lets triangles share vertices.
  *
  */
 
 #include "GL.hpp"
+#include "MeshFile.hpp"
+#include "Name.hpp"
 #include <glm/glm.hpp>
-#include <map>
+#include <cstdint>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 struct Mesh {
-	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
+	//Meshes are vertex (or index) ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or first index)
+	GLuint count = 0; //count of vertices (or indices)
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT if start/count are a range of the buffer's indices; GL_NONE if they are a range of vertices
+
+	//Vertex positions in the buffer map to positions in the mesh as position_offset + position_scale * position:
+	// (quantized buffers store each mesh's positions relative to its bounds; otherwise this is the identity)
+	glm::vec3 position_offset = glm::vec3(0.0f);
+	glm::vec3 position_scale = glm::vec3(1.0f);
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
@@ -29,26 +43,75 @@ struct Mesh {
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
 };
 
+//MeshHandle refers to a mesh in a particular MeshBuffer (by its index in MeshBuffer::meshes):
+struct MeshHandle {
+	uint32_t index = -1U; //-1U if no mesh
+	explicit operator bool() const { return index != -1U; }
+	bool operator==(MeshHandle const &other) const { return index == other.index; }
+	bool operator!=(MeshHandle const &other) const { return index != other.index; }
+};
+
 struct MeshBuffer {
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// if 'upload_now' is false, makes no OpenGL calls (so it can run on a worker thread) -- call upload() before drawing
+	// if 'optimize' is true, meshes are indexed and reordered for the vertex cache as they load (see MeshFile::optimize)
+	//  (this takes a while on big files; 'scenes/convert-meshes --optimize' does the same thing ahead of time)
+	MeshBuffer(std::string const &filename, bool upload_now = true, bool optimize = false);
+
+	//copy the vertex (and index) data read from the file into 'buffer' (and 'index_buffer'), creating them if needed:
+	void upload();
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
+	//..or get nullptr if it isn't there:
+	const Mesh *find(std::string const &name) const;
+
+	//resolve a mesh name to a handle (an empty handle if the mesh isn't there):
+	// (a Name's hash is already known, so resolving one doesn't hash its string)
+	MeshHandle handle(std::string_view const &name) const;
+	MeshHandle handle(std::string const &name) const { return handle(std::string_view(name)); }
+	MeshHandle handle(char const *name) const { return handle(std::string_view(name)); }
+	MeshHandle handle(Name const &name) const;
+	//get the mesh (or its name) for a handle from this buffer:
+	const Mesh &get(MeshHandle handle) const { return meshes[handle.index]; }
+	Name const &name(MeshHandle handle) const { return mesh_names[handle.index]; }
 	
 	//build a vertex array object that links this vbo to attributes to a program:
+	// (also binds the element array buffer, if there is one)
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
+	// (0 until upload())
 	GLuint buffer = 0;
 
+	//..and the element array buffer containing indices, for indexed files:
+	// (0 until upload(), and always 0 if the file isn't indexed)
+	GLuint index_buffer = 0;
+	GLenum index_type = GL_NONE; //type of the indices in index_buffer (GL_NONE if not indexed)
+
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//vertex and index data waiting for upload():
+	// (taken over from the MeshFile rather than copied; only the vectors matching the buffer's formats are filled)
+	std::vector< MeshFile::Vertex > vertex_data;
+	std::vector< MeshFile::QuantizedVertex > quantized_vertex_data;
+	std::vector< uint32_t > index_data;
+	std::vector< uint16_t > small_index_data;
+
+	//meshes, in file order (MeshHandle::index is an index into these), and their names:
+	std::vector< Mesh > meshes;
+	std::vector< Name > mesh_names;
+
+	//used by the handle() (and so lookup() and find()) functions:
+	// open-addressed hash table (linear probing, at most half full) of Name::hash_string(name) -> index in meshes
+	struct Slot {
+		size_t hash = 0;
+		uint32_t index = -1U; //-1U for empty slots
+	};
+	std::vector< Slot > slots;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
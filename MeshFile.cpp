@@ -0,0 +1,711 @@
+#include "MeshFile.hpp"
+#include "ThreadPool.hpp"
+#include "read_write_chunk.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+MeshFile::MeshFile(std::string const &filename) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+
+	std::ifstream file(filename, std::ios::binary);
+	if (peek_chunk(file, "pnq0")) {
+		read_chunk(file, "pnq0", &packed);
+		quantized = true;
+	} else {
+		read_chunk(file, "pnct", &vertices);
+	}
+	size_t vertex_count = (quantized ? packed.size() : vertices.size());
+
+	if (peek_chunk(file, "ix16")) {
+		std::vector< uint16_t > small;
+		read_chunk(file, "ix16", &small);
+		indices.assign(small.begin(), small.end());
+		indexed = true;
+	} else if (peek_chunk(file, "ix32")) {
+		read_chunk(file, "ix32", &indices);
+		indexed = true;
+	}
+	for (uint32_t i : indices) {
+		if (i >= vertex_count) {
+			throw std::runtime_error("mesh file '" + filename + "' contains an out-of-range vertex index");
+		}
+	}
+
+	std::vector< char > strings;
+	read_chunk(file, "str0", &strings);
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	std::vector< IndexEntry > index;
+	read_chunk(file, "idx0", &index);
+
+	size_t total = (indexed ? indices.size() : vertex_count);
+	meshes.reserve(index.size());
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		meshes.emplace_back();
+		meshes.back().name = std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+		meshes.back().begin = entry.vertex_begin;
+		meshes.back().end = entry.vertex_end;
+	}
+
+	if (quantized) {
+		struct BoxEntry {
+			glm::vec3 offset;
+			glm::vec3 scale;
+		};
+		static_assert(sizeof(BoxEntry) == 4*3 + 4*3, "BoxEntry is packed.");
+
+		std::vector< BoxEntry > boxes;
+		read_chunk(file, "pbx0", &boxes);
+		if (boxes.size() != meshes.size()) {
+			throw std::runtime_error("mesh file '" + filename + "' has a different number of position boxes than meshes");
+		}
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			meshes[m].position_offset = boxes[m].offset;
+			meshes[m].position_scale = boxes[m].scale;
+		}
+		dequantize(packed);
+	}
+
+	if (peek_chunk(file, "bnd0")) {
+		struct BoundsEntry {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+		static_assert(sizeof(BoundsEntry) == 4*3 + 4*3, "BoundsEntry is packed.");
+
+		std::vector< BoundsEntry > stored;
+		read_chunk(file, "bnd0", &stored);
+		if (stored.size() != meshes.size()) {
+			throw std::runtime_error("mesh file '" + filename + "' has a different number of bounds than meshes");
+		}
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			meshes[m].min = stored[m].min;
+			meshes[m].max = stored[m].max;
+		}
+		bounds = true;
+	}
+
+	if (peek_chunk(file, "err0")) {
+		std::vector< float > stored;
+		read_chunk(file, "err0", &stored);
+		if (stored.size() != meshes.size()) {
+			throw std::runtime_error("mesh file '" + filename + "' has a different number of errors than meshes");
+		}
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			meshes[m].error = stored[m];
+		}
+		errors = true;
+	}
+
+	if (file.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	}
+}
+
+void MeshFile::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+
+	if (quantized) {
+		write_chunk("pnq0", quantized_vertices(), &file);
+	} else {
+		write_chunk("pnct", vertices, &file);
+	}
+
+	if (indexed) {
+		if (small_indices()) {
+			std::vector< uint16_t > small(indices.begin(), indices.end());
+			write_chunk("ix16", small, &file);
+		} else {
+			write_chunk("ix32", indices, &file);
+		}
+	}
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	index.reserve(meshes.size());
+	for (auto const &mesh : meshes) {
+		IndexEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), mesh.name.begin(), mesh.name.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.vertex_begin = mesh.begin;
+		entry.vertex_end = mesh.end;
+		index.emplace_back(entry);
+	}
+	write_chunk("str0", strings, &file);
+	write_chunk("idx0", index, &file);
+
+	if (quantized) {
+		struct BoxEntry {
+			glm::vec3 offset;
+			glm::vec3 scale;
+		};
+		static_assert(sizeof(BoxEntry) == 4*3 + 4*3, "BoxEntry is packed.");
+
+		std::vector< BoxEntry > boxes;
+		boxes.reserve(meshes.size());
+		for (auto const &mesh : meshes) {
+			boxes.emplace_back(BoxEntry{ mesh.position_offset, mesh.position_scale });
+		}
+		write_chunk("pbx0", boxes, &file);
+	}
+
+	if (bounds) {
+		struct BoundsEntry {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+		static_assert(sizeof(BoundsEntry) == 4*3 + 4*3, "BoundsEntry is packed.");
+
+		std::vector< BoundsEntry > stored;
+		stored.reserve(meshes.size());
+		for (auto const &mesh : meshes) {
+			stored.emplace_back(BoundsEntry{ mesh.min, mesh.max });
+		}
+		write_chunk("bnd0", stored, &file);
+	}
+
+	if (errors) {
+		std::vector< float > stored;
+		stored.reserve(meshes.size());
+		for (auto const &mesh : meshes) {
+			stored.emplace_back(mesh.error);
+		}
+		write_chunk("err0", stored, &file);
+	}
+
+	if (!file) {
+		throw std::runtime_error("Failed to write mesh file '" + filename + "'.");
+	}
+}
+
+void MeshFile::weld() {
+	//vertices are compared bit-for-bit (Vertex has no padding):
+	struct VertexHash {
+		size_t operator()(Vertex const &v) const {
+			uint64_t hash = 0xcbf29ce484222325ULL; //FNV-1a, as in Name::hash_string
+			unsigned char const *bytes = reinterpret_cast< unsigned char const * >(&v);
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+			}
+			return size_t(hash);
+		}
+	};
+	struct VertexEqual {
+		bool operator()(Vertex const &a, Vertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	//meshes may not cover every element, so weld only the ranges they use:
+	// (entries that share a range keep sharing it)
+	std::map< std::pair< uint32_t, uint32_t >, std::pair< uint32_t, uint32_t > > welded_ranges;
+	std::vector< Vertex > welded;
+	std::vector< uint32_t > welded_indices;
+	std::unordered_map< Vertex, uint32_t, VertexHash, VertexEqual > lookup;
+	lookup.reserve(vertices.size());
+
+	for (auto &mesh : meshes) {
+		auto f = welded_ranges.find(std::make_pair(mesh.begin, mesh.end));
+		if (f != welded_ranges.end()) {
+			mesh.begin = f->second.first;
+			mesh.end = f->second.second;
+			continue;
+		}
+		uint32_t begin = uint32_t(welded_indices.size());
+		for (uint32_t i = mesh.begin; i < mesh.end; ++i) {
+			Vertex const &v = element(i);
+			auto ret = lookup.emplace(v, uint32_t(welded.size()));
+			if (ret.second) welded.emplace_back(v);
+			welded_indices.emplace_back(ret.first->second);
+		}
+		welded_ranges.emplace(std::make_pair(mesh.begin, mesh.end), std::make_pair(begin, uint32_t(welded_indices.size())));
+		mesh.begin = begin;
+		mesh.end = uint32_t(welded_indices.size());
+	}
+
+	vertices = std::move(welded);
+	indices = std::move(welded_indices);
+	indexed = true;
+	packed.clear();
+
+	//vertices in meshes with different position boxes may have been merged, so copy them apart again:
+	if (quantized) quantize();
+}
+
+//distinct [begin,end) ranges used by meshes, sorted; 'separate' is set for ranges that don't partly overlap any other range:
+static void distinct_ranges(std::vector< MeshFile::Entry > const &meshes, std::vector< std::pair< uint32_t, uint32_t > > *ranges, std::vector< bool > *separate) {
+	ranges->clear();
+	for (auto const &mesh : meshes) {
+		if (mesh.begin < mesh.end) ranges->emplace_back(mesh.begin, mesh.end);
+	}
+	std::sort(ranges->begin(), ranges->end());
+	ranges->erase(std::unique(ranges->begin(), ranges->end()), ranges->end());
+
+	separate->assign(ranges->size(), true);
+	uint32_t max_end = 0;
+	size_t max_end_range = 0;
+	for (size_t r = 0; r < ranges->size(); ++r) {
+		if ((*ranges)[r].first < max_end) {
+			(*separate)[r] = false;
+			(*separate)[max_end_range] = false;
+		}
+		if ((*ranges)[r].second > max_end) {
+			max_end = (*ranges)[r].second;
+			max_end_range = r;
+		}
+	}
+}
+
+MeshFile::CacheStats MeshFile::cache_stats(uint32_t cache_size) const {
+	CacheStats stats;
+
+	std::vector< std::pair< uint32_t, uint32_t > > ranges;
+	std::vector< bool > separate;
+	distinct_ranges(meshes, &ranges, &separate);
+
+	//a vertex is in the cache if fewer than cache_size misses have happened since it was loaded:
+	std::vector< uint64_t > loaded_at(vertices.size(), 0);
+	std::vector< uint32_t > seen_in(vertices.size(), -1U);
+	uint64_t misses = 0;
+	for (uint32_t r = 0; r < uint32_t(ranges.size()); ++r) {
+		uint64_t range_start = misses; //(the cache starts empty for each mesh)
+		for (uint32_t i = ranges[r].first; i < ranges[r].second; ++i) {
+			uint32_t v = (indexed ? indices[i] : i);
+			if (seen_in[v] != r) {
+				seen_in[v] = r;
+				stats.vertices += 1;
+			} else if (loaded_at[v] >= range_start && misses - loaded_at[v] < cache_size) {
+				continue;
+			}
+			loaded_at[v] = misses;
+			misses += 1;
+		}
+		stats.triangles += (ranges[r].second - ranges[r].first) / 3;
+	}
+	stats.misses = misses;
+
+	return stats;
+}
+
+//Tipsify (from Sander, Nehab, and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007):
+// reorders the triangles in 'tris' (three indices per triangle, into 'vertex_count' vertices) into 'out'
+// appends the first triangle of each cluster to 'clusters' -- a new cluster starts wherever the walk jumps to a vertex no longer in the cache
+static void tipsify(std::vector< uint32_t > const &tris, uint32_t vertex_count, uint32_t cache_size, std::vector< uint32_t > *out, std::vector< uint32_t > *clusters) {
+	uint32_t triangle_count = uint32_t(tris.size() / 3);
+
+	//triangles using each vertex, and how many of them are yet to be emitted:
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t v : tris) offsets[v + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+	std::vector< uint32_t > adjacent(tris.size());
+	std::vector< uint32_t > live(vertex_count);
+	{
+		std::vector< uint32_t > next(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < uint32_t(tris.size()); ++i) {
+			adjacent[next[tris[i]]++] = i / 3;
+		}
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) live[v] = offsets[v + 1] - offsets[v];
+
+	std::vector< uint32_t > stamp(vertex_count, 0); //'time' at which each vertex entered the cache
+	uint32_t time = cache_size + 1; //(so every vertex starts out of the cache)
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > dead_ends; //recently used vertices, to return to when the walk gets stuck
+	std::vector< uint32_t > candidates;
+	uint32_t cursor = 0; //vertices before this have no triangles left
+
+	out->clear();
+	clusters->clear();
+	if (triangle_count == 0) return;
+	clusters->emplace_back(0);
+
+	uint32_t fan = tris[0];
+	while (fan != -1U) {
+		//emit all remaining triangles around 'fan':
+		candidates.clear();
+		for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+			uint32_t t = adjacent[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = tris[3 * t + k];
+				out->emplace_back(v);
+				dead_ends.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - stamp[v] > cache_size) {
+					stamp[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//next fan: the oldest candidate that will still be in the cache once its remaining triangles are emitted:
+		uint32_t next = -1U;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - stamp[v] + 2 * live[v] <= cache_size) priority = time - stamp[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		if (next == -1U) {
+			//dead end: go back to a recently used vertex, or else to any vertex with triangles left:
+			while (!dead_ends.empty()) {
+				uint32_t v = dead_ends.back();
+				dead_ends.pop_back();
+				if (live[v] > 0) {
+					next = v;
+					break;
+				}
+			}
+			if (next == -1U) {
+				while (cursor < vertex_count && live[cursor] == 0) ++cursor;
+				if (cursor < vertex_count) next = cursor;
+			}
+			if (next != -1U && time - stamp[next] > cache_size) {
+				clusters->emplace_back(uint32_t(out->size() / 3));
+			}
+		}
+		fan = next;
+	}
+	assert(out->size() == tris.size());
+}
+
+void MeshFile::optimize(uint32_t cache_size) {
+	if (!indexed) weld();
+
+	std::vector< std::pair< uint32_t, uint32_t > > ranges;
+	std::vector< bool > separate;
+	distinct_ranges(meshes, &ranges, &separate);
+
+	std::vector< uint32_t > local_of(vertices.size(), -1U); //(reset after each range)
+	std::vector< uint32_t > global_of;
+	std::vector< uint32_t > tris, ordered, clusters;
+	struct Cluster {
+		uint32_t begin, end; //triangles in 'ordered'
+		float facing; //how much the cluster faces away from the mesh's center
+	};
+	std::vector< Cluster > sorted;
+
+	for (size_t r = 0; r < ranges.size(); ++r) {
+		uint32_t begin = ranges[r].first;
+		uint32_t end = ranges[r].second;
+		if (!separate[r] || (end - begin) % 3 != 0) continue;
+
+		//number the mesh's vertices locally:
+		global_of.clear();
+		tris.clear();
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t v = indices[i];
+			if (local_of[v] == -1U) {
+				local_of[v] = uint32_t(global_of.size());
+				global_of.emplace_back(v);
+			}
+			tris.emplace_back(local_of[v]);
+		}
+		for (uint32_t v : global_of) local_of[v] = -1U;
+
+		tipsify(tris, uint32_t(global_of.size()), cache_size, &ordered, &clusters);
+
+		//Draw clusters that face outward (and so are likely to occlude the rest of the mesh) first:
+		// (the "fast" overdraw ordering from the same paper -- clusters are sorted by dot(cluster center - mesh center, cluster normal))
+		auto position = [&](uint32_t local) -> glm::vec3 const & {
+			return vertices[global_of[local]].Position;
+		};
+		glm::vec3 mesh_center = glm::vec3(0.0f);
+		float mesh_area = 0.0f;
+		sorted.clear();
+		for (uint32_t c = 0; c < uint32_t(clusters.size()); ++c) {
+			Cluster cluster;
+			cluster.begin = clusters[c];
+			cluster.end = (c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(ordered.size() / 3));
+			cluster.facing = 0.0f;
+			sorted.emplace_back(cluster);
+		}
+		std::vector< glm::vec3 > centers(sorted.size()), normals(sorted.size());
+		for (uint32_t c = 0; c < uint32_t(sorted.size()); ++c) {
+			glm::vec3 center = glm::vec3(0.0f);
+			glm::vec3 normal = glm::vec3(0.0f);
+			float area = 0.0f;
+			for (uint32_t t = sorted[c].begin; t < sorted[c].end; ++t) {
+				glm::vec3 const &a = position(ordered[3*t+0]);
+				glm::vec3 const &b = position(ordered[3*t+1]);
+				glm::vec3 const &d = position(ordered[3*t+2]);
+				glm::vec3 n = glm::cross(b - a, d - a); //(length is twice the area)
+				float w = glm::length(n);
+				center += w * (a + b + d) / 3.0f;
+				normal += n;
+				area += w;
+			}
+			centers[c] = (area > 0.0f ? center / area : position(ordered[3*sorted[c].begin]));
+			normals[c] = normal;
+			mesh_center += center;
+			mesh_area += area;
+		}
+		if (mesh_area > 0.0f) mesh_center /= mesh_area;
+		for (uint32_t c = 0; c < uint32_t(sorted.size()); ++c) {
+			float length = glm::length(normals[c]);
+			sorted[c].facing = (length > 0.0f ? glm::dot(centers[c] - mesh_center, normals[c] / length) : 0.0f);
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](Cluster const &a, Cluster const &b) {
+			return a.facing > b.facing;
+		});
+
+		uint32_t *to = indices.data() + begin;
+		for (Cluster const &cluster : sorted) {
+			for (uint32_t i = 3 * cluster.begin; i < 3 * cluster.end; ++i) {
+				*(to++) = global_of[ordered[i]];
+			}
+		}
+		assert(to == indices.data() + end);
+	}
+
+	//Renumber vertices in order of first use, so the vertex fetches follow the triangles through memory:
+	// (vertices that no index refers to are dropped)
+	std::vector< uint32_t > renumber(vertices.size(), -1U);
+	std::vector< Vertex > fetched;
+	fetched.reserve(vertices.size());
+	for (uint32_t &i : indices) {
+		if (renumber[i] == -1U) {
+			renumber[i] = uint32_t(fetched.size());
+			fetched.emplace_back(vertices[i]);
+		}
+		i = renumber[i];
+	}
+	vertices = std::move(fetched);
+	packed.clear();
+}
+
+void MeshFile::quantize() {
+	quantized = true;
+	if (!indexed) {
+		weld(); //(calls back into quantize() once indexed)
+		return;
+	}
+
+	//meshes whose ranges overlap must share a position box, so group them:
+	std::vector< std::pair< uint32_t, uint32_t > > ranges;
+	std::vector< bool > separate;
+	distinct_ranges(meshes, &ranges, &separate);
+
+	struct Group {
+		uint32_t begin, end;
+		glm::vec3 min, max;
+	};
+	std::vector< Group > groups;
+	for (auto const &range : ranges) {
+		if (!groups.empty() && range.first < groups.back().end) {
+			groups.back().end = std::max(groups.back().end, range.second);
+		} else {
+			groups.emplace_back(Group{ range.first, range.second,
+				glm::vec3( std::numeric_limits< float >::infinity()),
+				glm::vec3(-std::numeric_limits< float >::infinity()) });
+		}
+	}
+
+	//give each group its own copy of any vertex that an earlier group already uses:
+	size_t original_count = vertices.size();
+	std::vector< bool > used(original_count, false);
+	std::vector< uint32_t > copy_in_group(original_count, -1U); //(reset after each group)
+	std::vector< uint32_t > touched;
+	for (Group &group : groups) {
+		touched.clear();
+		for (uint32_t i = group.begin; i < group.end; ++i) {
+			uint32_t v = indices[i];
+			if (copy_in_group[v] == -1U) {
+				if (!used[v]) {
+					used[v] = true;
+					copy_in_group[v] = v;
+				} else {
+					copy_in_group[v] = uint32_t(vertices.size());
+					Vertex copy = vertices[v];
+					vertices.emplace_back(copy);
+				}
+				touched.emplace_back(v);
+			}
+			indices[i] = copy_in_group[v];
+			group.min = glm::min(group.min, vertices[indices[i]].Position);
+			group.max = glm::max(group.max, vertices[indices[i]].Position);
+		}
+		for (uint32_t v : touched) copy_in_group[v] = -1U;
+	}
+
+	//each mesh uses the box of its group:
+	for (auto &mesh : meshes) {
+		mesh.position_offset = glm::vec3(0.0f);
+		mesh.position_scale = glm::vec3(1.0f);
+		if (!(mesh.begin < mesh.end)) continue;
+		auto g = std::upper_bound(groups.begin(), groups.end(), mesh.begin, [](uint32_t begin, Group const &group) {
+			return begin < group.begin;
+		});
+		assert(g != groups.begin());
+		--g;
+		assert(g->begin <= mesh.begin && mesh.end <= g->end);
+		mesh.position_offset = g->min;
+		mesh.position_scale = g->max - g->min;
+		//(flat meshes quantize to zero along their flat axes; any scale will do)
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (!(mesh.position_scale[c] > 0.0f)) mesh.position_scale[c] = 1.0f;
+		}
+	}
+
+	//round vertices to what will be stored:
+	packed = quantized_vertices();
+	dequantize(packed);
+	if (bounds) compute_bounds();
+}
+
+std::vector< uint32_t > MeshFile::vertex_boxes(size_t vertex_count) const {
+	std::vector< uint32_t > boxes(vertex_count, -1U);
+	for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m) {
+		Entry const &mesh = meshes[m];
+		for (uint32_t i = mesh.begin; i < mesh.end; ++i) {
+			uint32_t v = (indexed ? indices[i] : i);
+			uint32_t &box = boxes[v];
+			if (box == m) continue;
+			if (box != -1U && (meshes[box].position_offset != mesh.position_offset || meshes[box].position_scale != mesh.position_scale)) {
+				throw std::runtime_error("mesh '" + mesh.name + "' shares vertices with mesh '" + meshes[box].name + "', which has a different position box");
+			}
+			box = m;
+		}
+	}
+	return boxes;
+}
+
+std::vector< MeshFile::QuantizedVertex > MeshFile::quantized_vertices() const {
+	std::vector< uint32_t > boxes = vertex_boxes(vertices.size());
+
+	std::vector< QuantizedVertex > ret(vertices.size());
+	for (size_t v = 0; v < vertices.size(); ++v) {
+		Vertex const &from = vertices[v];
+		QuantizedVertex &to = ret[v];
+
+		glm::vec3 offset = (boxes[v] != -1U ? meshes[boxes[v]].position_offset : glm::vec3(0.0f));
+		glm::vec3 scale = (boxes[v] != -1U ? meshes[boxes[v]].position_scale : glm::vec3(1.0f));
+		glm::vec3 unit = glm::clamp((from.Position - offset) / scale, glm::vec3(0.0f), glm::vec3(1.0f));
+		to.Position = glm::u16vec3(glm::round(unit * 65535.0f));
+		to.padding = 0;
+
+		//(normals are stored as they are -- not re-normalized -- so that quantizing a quantized file changes nothing)
+		to.Normal = glm::packSnorm3x10_1x2(glm::vec4(from.Normal, 0.0f));
+
+		to.Color = from.Color;
+		to.TexCoord = glm::u16vec2(glm::packHalf1x16(from.TexCoord.x), glm::packHalf1x16(from.TexCoord.y));
+	}
+	return ret;
+}
+
+void MeshFile::dequantize(std::vector< QuantizedVertex > const &from_packed) {
+	std::vector< uint32_t > boxes = vertex_boxes(from_packed.size());
+
+	vertices.resize(from_packed.size());
+	for (size_t v = 0; v < from_packed.size(); ++v) {
+		QuantizedVertex const &from = from_packed[v];
+		Vertex &to = vertices[v];
+
+		glm::vec3 offset = (boxes[v] != -1U ? meshes[boxes[v]].position_offset : glm::vec3(0.0f));
+		glm::vec3 scale = (boxes[v] != -1U ? meshes[boxes[v]].position_scale : glm::vec3(1.0f));
+		to.Position = offset + scale * (glm::vec3(from.Position) / 65535.0f);
+		to.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(from.Normal));
+		to.Color = from.Color;
+		to.TexCoord = glm::vec2(glm::unpackHalf1x16(from.TexCoord.x), glm::unpackHalf1x16(from.TexCoord.y));
+	}
+}
+
+//bounds of the positions of elements [begin,end):
+template< typename PositionAt >
+static void range_bounds(PositionAt const &position_at, uint32_t begin, uint32_t end, glm::vec3 *min_, glm::vec3 *max_) {
+	//(accumulate in locals, so they can stay in registers rather than being stored through the pointers every step)
+	glm::vec3 min = *min_;
+	glm::vec3 max = *max_;
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::vec3 const &p = position_at(i);
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	*min_ = min;
+	*max_ = max;
+}
+
+void MeshFile::compute_bounds(ThreadPool *pool) {
+	//split meshes into pieces of at most this many elements, to spread big meshes between threads:
+	constexpr uint32_t PieceSize = 1 << 16;
+
+	struct Piece {
+		uint32_t mesh;
+		uint32_t begin, end;
+		glm::vec3 min, max;
+	};
+	std::vector< Piece > pieces;
+	for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m) {
+		for (uint32_t begin = meshes[m].begin; begin < meshes[m].end; begin += std::min(PieceSize, meshes[m].end - begin)) {
+			pieces.emplace_back(Piece{ m, begin, begin + std::min(PieceSize, meshes[m].end - begin),
+				glm::vec3( std::numeric_limits< float >::infinity()),
+				glm::vec3(-std::numeric_limits< float >::infinity()) });
+		}
+	}
+
+	auto do_pieces = [this,&pieces](uint32_t begin, uint32_t end) {
+		for (uint32_t p = begin; p < end; ++p) {
+			Piece &piece = pieces[p];
+			Vertex const *vertex = vertices.data();
+			uint32_t const *index = indices.data();
+			if (indexed) {
+				range_bounds([vertex,index](uint32_t i) -> glm::vec3 const & { return vertex[index[i]].Position; }, piece.begin, piece.end, &piece.min, &piece.max);
+			} else {
+				range_bounds([vertex](uint32_t i) -> glm::vec3 const & { return vertex[i].Position; }, piece.begin, piece.end, &piece.min, &piece.max);
+			}
+		}
+	};
+	if (pool && pieces.size() > 1) {
+		pool->parallel_for(uint32_t(pieces.size()), do_pieces);
+	} else {
+		do_pieces(0, uint32_t(pieces.size()));
+	}
+
+	for (auto &mesh : meshes) {
+		mesh.min = glm::vec3( std::numeric_limits< float >::infinity());
+		mesh.max = glm::vec3(-std::numeric_limits< float >::infinity());
+	}
+	for (Piece const &piece : pieces) {
+		meshes[piece.mesh].min = glm::min(meshes[piece.mesh].min, piece.min);
+		meshes[piece.mesh].max = glm::max(meshes[piece.mesh].max, piece.max);
+	}
+	bounds = true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+/*
+ * MeshFile holds the contents of a ".pnct" mesh file in CPU memory, so that
+ *  it can be inspected or transformed (e.g., by offline tools) without
+ *  creating any OpenGL objects. MeshBuffer uses it to read files.
+ *
+ * File layout (chunks as in read_write_chunk.hpp):
+ *  "pnct" - vertices (MeshFile::Vertex)
+ *    ..or "pnq0" - quantized vertices (MeshFile::QuantizedVertex)
+ *  "ix16" or "ix32" - (optional) triangle-corner indices into the vertices, as uint16_t or uint32_t
+ *  "str0" - mesh names
+ *  "idx0" - name and [begin,end) range of each mesh; ranges are of indices if the file has an index chunk, otherwise of vertices
+ *  "pbx0" - (only with "pnq0") offset and scale that map each mesh's quantized positions back to positions
+ *  "bnd0" - (optional) min and max of each mesh's positions, so they needn't be computed when loading
+ *  "err0" - (optional) simplification error of each mesh (see Entry::error; written by simplify-meshes)
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct ThreadPool;
+
+struct MeshFile {
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	std::vector< Vertex > vertices;
+
+	//if 'quantized', save() stores vertices in this compact format (and MeshBuffer uploads them that way):
+	// (positions are relative to their mesh's position box -- see Entry -- and normals are GL_INT_2_10_10_10_REV)
+	bool quantized = false;
+	struct QuantizedVertex {
+		glm::u16vec3 Position; //normalized: (position - position_offset) / position_scale
+		uint16_t padding;
+		uint32_t Normal; //signed normalized, x/y/z in 10 bits each (glm::packSnorm3x10_1x2)
+		glm::u8vec4 Color;
+		glm::u16vec2 TexCoord; //half-floats (glm::packHalf1x16)
+	};
+	static_assert(sizeof(QuantizedVertex) == 3*2+2+4+4*1+2*2, "QuantizedVertex is packed.");
+
+	//(quantized files) the vertices exactly as read from the file, so MeshBuffer can upload them without quantizing again:
+	// only valid while it matches 'vertices' -- weld(), optimize(), and quantize() keep it up to date (or clear it),
+	// but code that changes 'vertices' directly should clear it
+	std::vector< QuantizedVertex > packed;
+
+	//if 'indexed', meshes are ranges of 'indices' (which refer to 'vertices'); otherwise they are ranges of 'vertices':
+	bool indexed = false;
+	std::vector< uint32_t > indices;
+
+	struct Entry {
+		std::string name;
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		//(quantized files) quantized positions in this range map back to position_offset + position_scale * position:
+		glm::vec3 position_offset = glm::vec3(0.0f);
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		//bounds of the positions the mesh uses (only set if 'bounds' is):
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		//(simplified levels of detail) about how far -- in mesh units -- the mesh strays from the mesh it was simplified from; 0 for other meshes:
+		float error = 0.0f;
+	};
+	std::vector< Entry > meshes;
+
+	//if 'bounds', each mesh's min/max are set (from the file, or by compute_bounds()) and save() stores them:
+	bool bounds = false;
+
+	//if 'errors', save() stores each mesh's error:
+	bool errors = false;
+
+	//empty file:
+	MeshFile() = default;
+	//read from a file:
+	// note: will throw if file fails to read.
+	MeshFile(std::string const &filename);
+
+	//write to a file:
+	// (indices are stored as uint16_t when every vertex can be addressed that way)
+	void save(std::string const &filename) const;
+
+	//index type that save() -- and MeshBuffer -- use: 16-bit if there are few enough vertices, otherwise 32-bit:
+	bool small_indices() const { return vertices.size() <= 0x10000; }
+
+	//vertex used by the i'th element of mesh range [begin,end):
+	Vertex const &element(uint32_t i) const { return indexed ? vertices[indices[i]] : vertices[i]; }
+
+	//merge identical vertices, making this file indexed:
+	// (mesh ranges become index ranges; vertices stay in order of first use)
+	void weld();
+
+	//post-transform vertex cache behavior of the meshes, simulated with a first-in-first-out cache of 'cache_size' vertices:
+	// (meshes that share a range are counted once)
+	enum : uint32_t { DefaultCacheSize = 16 };
+	struct CacheStats {
+		uint64_t triangles = 0;
+		uint64_t vertices = 0; //distinct vertices used by each mesh
+		uint64_t misses = 0; //vertices transformed (i.e., vertex shader invocations)
+		//average cache miss ratio -- transformed vertices per triangle (3 is the worst; about 0.5 is the best possible on large meshes):
+		float acmr() const { return triangles ? float(misses) / float(triangles) : 0.0f; }
+		//average transform to vertex ratio -- times each vertex is transformed (1 is ideal):
+		float atvr() const { return vertices ? float(misses) / float(vertices) : 0.0f; }
+	};
+	CacheStats cache_stats(uint32_t cache_size = DefaultCacheSize) const;
+
+	//reorder each mesh's triangles for the vertex cache (Tipsify), then -- in clusters, so most of the cache locality is kept -- for less overdraw,
+	// then renumber vertices in order of first use (so vertex fetches are sequential):
+	// (welds first if not indexed; each mesh keeps its index range, so meshes only change in triangle order)
+	// (meshes whose ranges partly overlap other meshes' ranges are left as they are)
+	void optimize(uint32_t cache_size = DefaultCacheSize);
+
+	//set each mesh's min/max (and 'bounds'):
+	// if 'pool' is given, the vertices are split between its threads
+	void compute_bounds(ThreadPool *pool = nullptr);
+
+	//store vertices as QuantizedVertex (see above), with positions relative to the bounds of each mesh:
+	// (welds first if not indexed; meshes whose ranges overlap share bounds, and vertices used by meshes with different bounds are copied)
+	// (vertices are rounded to the values that will be stored, so mesh bounds are recomputed if set)
+	void quantize();
+
+	//vertices in quantized form, using the position box of a mesh that uses each one:
+	// note: will throw if a vertex is used by meshes with different position boxes (quantize() avoids this)
+	std::vector< QuantizedVertex > quantized_vertices() const;
+
+	//-- internals ---
+
+	//index of the mesh whose position box applies to each vertex (-1U for vertices no mesh uses):
+	// note: will throw if a vertex is used by meshes with different position boxes
+	std::vector< uint32_t > vertex_boxes(size_t vertex_count) const;
+	//set 'vertices' from quantized vertices (using the meshes' position boxes):
+	void dequantize(std::vector< QuantizedVertex > const &from_packed);
+};
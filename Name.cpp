@@ -0,0 +1,76 @@
+#include "Name.hpp"
+
+#include <cassert>
+#include <memory>
+#include <mutex>
+
+//The pool of interned strings:
+// (allocated once and never freed, so Names stay valid even during static destruction)
+struct NamePool {
+	NamePool() {
+		empty = intern("", Name::hash_string(""));
+	}
+
+	Name::Entry const *intern(std::string_view const &str, uint64_t hash) {
+		assert(hash == Name::hash_string(str));
+		std::lock_guard< std::mutex > lock(mutex);
+		auto f = entries.find(Key{ str, size_t(hash) });
+		if (f != entries.end()) return f->second.get();
+
+		std::unique_ptr< Name::Entry > entry(new Name::Entry{ std::string(str), size_t(hash) });
+		Name::Entry const *ret = entry.get();
+		entries.emplace(Key{ std::string_view(ret->str), ret->hash }, std::move(entry)); //(key refers to the entry's own string)
+		return ret;
+	}
+
+	Name::Entry const *find(std::string_view const &str) {
+		std::lock_guard< std::mutex > lock(mutex);
+		auto f = entries.find(Key{ str, size_t(Name::hash_string(str)) });
+		if (f != entries.end()) return f->second.get();
+		return empty;
+	}
+
+	//keys carry their hash along, so strings are only hashed once (or not at all, if the hash was stored):
+	struct Key {
+		std::string_view str;
+		size_t hash;
+		bool operator==(Key const &other) const { return str == other.str; }
+	};
+	struct KeyHash {
+		size_t operator()(Key const &key) const { return key.hash; }
+	};
+
+	std::mutex mutex;
+	std::unordered_map< Key, std::unique_ptr< Name::Entry >, KeyHash > entries;
+	Name::Entry const *empty = nullptr;
+};
+
+static NamePool &pool() {
+	static NamePool *pool = new NamePool;
+	return *pool;
+}
+
+Name::Name() : entry(pool().empty) {
+}
+
+Name::Name(std::string_view const &str) : entry(pool().intern(str, hash_string(str))) {
+}
+
+Name::Name(std::string_view const &str, uint64_t hash) : entry(pool().intern(str, hash)) {
+}
+
+uint64_t Name::hash_string(std::string_view const &str) {
+	//64-bit FNV-1a:
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : str) {
+		hash ^= uint8_t(c);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+Name Name::find(std::string_view const &str) {
+	Name ret;
+	ret.entry = pool().find(str);
+	return ret;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+ * A Name is a compact handle to a string stored ("interned") in a shared pool:
+ *
+ * Name a = "Player";
+ * Name b = std::string("Play") + "er";
+ * assert(a == b); //compares handles, not strings
+ * std::cout << a.str() << std::endl;
+ *
+ * Interning the same string always gives the same handle, so Names are
+ * cheap to copy, compare, and hash. Interned strings are never freed, so
+ * Names are meant for the (mostly fixed) set of names in a game's assets.
+ * Creating Names is thread-safe.
+ *
+ * NameIndex< T > maps Names to objects, with O(1) lookup by name and
+ * lookup by prefix.
+ *
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct Name {
+	//the empty name:
+	Name();
+
+	//intern a string:
+	// (implicit, so names can be assigned from strings directly)
+	Name(std::string_view const &str);
+	Name(std::string const &str) : Name(std::string_view(str)) { }
+	Name(char const *str) : Name(std::string_view(str)) { }
+	//..whose hash_string() is already known (e.g., stored in a file), which skips hashing it:
+	// (the hash is trusted -- only an assert checks it -- so only pass hashes that hash_string() wrote, e.g. upgrade-scene's nmh0 chunk)
+	Name(std::string_view const &str, uint64_t hash);
+
+	//the hash used for names -- stable across runs and platforms, so it can be precomputed and stored:
+	static uint64_t hash_string(std::string_view const &str);
+
+	//look up a string without interning it (returns the empty name if it was never interned):
+	static Name find(std::string_view const &str);
+
+	std::string const &str() const { return entry->str; }
+	bool empty() const { return entry->str.empty(); }
+	size_t hash() const { return entry->hash; }
+
+	//Names are equal if (and only if) their strings are equal:
+	bool operator==(Name const &other) const { return entry == other.entry; }
+	bool operator!=(Name const &other) const { return entry != other.entry; }
+	//comparing against strings directly doesn't intern them:
+	bool operator==(std::string_view const &other) const { return entry->str == other; }
+	bool operator!=(std::string_view const &other) const { return entry->str != other; }
+	bool operator==(char const *other) const { return entry->str == other; }
+	bool operator!=(char const *other) const { return entry->str != other; }
+	bool operator==(std::string const &other) const { return entry->str == other; }
+	bool operator!=(std::string const &other) const { return entry->str != other; }
+
+	//-- internals ---
+	struct Entry {
+		std::string str;
+		size_t hash;
+	};
+	Entry const *entry;
+};
+
+namespace std {
+	template< >
+	struct hash< Name > {
+		size_t operator()(Name const &name) const { return name.hash(); }
+	};
+}
+
+//Index of (name, object) pairs:
+template< typename T >
+struct NameIndex {
+	//replace the contents of the index:
+	void build(std::vector< std::pair< Name, T * > > &&entries);
+	void clear() { sorted.clear(); ranges.clear(); }
+
+	//first object with the given name (in the order given to build()), or nullptr:
+	T *find(Name const &name) const;
+	//append all objects with the given name to 'out' (in the order given to build()):
+	void find_all(Name const &name, std::vector< T * > *out) const;
+	//..or look up a string, without interning it (a string that was never interned can't be anyone's name):
+	T *find(std::string_view const &str) const;
+	void find_all(std::string_view const &str, std::vector< T * > *out) const;
+	//append all objects whose names start with 'prefix' to 'out' (sorted by name):
+	void find_prefix(std::string_view const &prefix, std::vector< T * > *out) const;
+
+	//-- internals ---
+	std::vector< std::pair< Name, T * > > sorted; //sorted by name string; objects with the same name keep their order
+	std::unordered_map< Name, std::pair< uint32_t, uint32_t > > ranges; //name -> [begin,end) in sorted
+};
+
+template< typename T >
+void NameIndex< T >::build(std::vector< std::pair< Name, T * > > &&entries) {
+	sorted = std::move(entries);
+	std::stable_sort(sorted.begin(), sorted.end(), [](std::pair< Name, T * > const &a, std::pair< Name, T * > const &b) {
+		return a.first.str() < b.first.str();
+	});
+	ranges.clear();
+	for (uint32_t begin = 0; begin < sorted.size(); /* later */) {
+		uint32_t end = begin + 1;
+		while (end < sorted.size() && sorted[end].first == sorted[begin].first) ++end;
+		ranges.emplace(sorted[begin].first, std::make_pair(begin, end));
+		begin = end;
+	}
+}
+
+template< typename T >
+T *NameIndex< T >::find(Name const &name) const {
+	auto f = ranges.find(name);
+	if (f == ranges.end()) return nullptr;
+	return sorted[f->second.first].second;
+}
+
+template< typename T >
+void NameIndex< T >::find_all(Name const &name, std::vector< T * > *out) const {
+	auto f = ranges.find(name);
+	if (f == ranges.end()) return;
+	for (uint32_t i = f->second.first; i < f->second.second; ++i) {
+		out->emplace_back(sorted[i].second);
+	}
+}
+
+template< typename T >
+T *NameIndex< T >::find(std::string_view const &str) const {
+	Name name = Name::find(str);
+	if (name.empty() && !str.empty()) return nullptr; //never interned
+	return find(name);
+}
+
+template< typename T >
+void NameIndex< T >::find_all(std::string_view const &str, std::vector< T * > *out) const {
+	Name name = Name::find(str);
+	if (name.empty() && !str.empty()) return; //never interned
+	find_all(name, out);
+}
+
+template< typename T >
+void NameIndex< T >::find_prefix(std::string_view const &prefix, std::vector< T * > *out) const {
+	auto begin = std::lower_bound(sorted.begin(), sorted.end(), prefix, [](std::pair< Name, T * > const &a, std::string_view const &b) {
+		return std::string_view(a.first.str()) < b;
+	});
+	for (auto i = begin; i != sorted.end(); ++i) {
+		if (std::string_view(i->first.str()).substr(0, prefix.size()) != prefix) break;
+		out->emplace_back(i->second);
+	}
+}
@@ -2,14 +2,27 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "ThreadPool.hpp"
+#include "Mesh.hpp"
+#include "Load.hpp"
+#include "MappedFile.hpp"
+#include "frustum_planes.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <string_view>
 
 //-------------------------
 
-glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+//local <-> parent matrices from position/rotation/scale:
+// (shared by Transform and PackedTransforms)
+static inline glm::mat4x3 local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   translate   *   rotate    *   scale
 	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
@@ -26,7 +39,7 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+static inline glm::mat4x3 parent_to_local(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   1/scale       *    rot^-1   *  translate^-1
 	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
@@ -56,18 +69,627 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
+glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+	return local_to_parent(position, rotation, scale);
+}
+
+glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+	return parent_to_local(position, rotation, scale);
+}
+
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
+	return update_world().local_to_world;
+}
+glm::mat4x3 Scene::Transform::make_world_to_local() const {
+	return update_world().world_to_local;
+}
+glm::mat3 Scene::Transform::make_normal_to_world() const {
+	//inverse(transpose(local_to_world)) == transpose(world_to_local), which is already cached:
+	return glm::transpose(glm::mat3(update_world().world_to_local));
+}
+
+std::atomic< uint64_t > Scene::Drawable::generation(1);
+
+Scene::Transform::WorldCache const &Scene::Transform::update_world() const {
+	//make sure parent's cache is current (n.b. this only compares values unless something changed):
+	uint32_t parent_version = (parent ? parent->update_world().version : 0);
+
+	if (world.version != 0
+	 && world.parent == parent
+	 && world.parent_version == parent_version
+	 && world.position == position
+	 && world.rotation == rotation
+	 && world.scale == scale) {
+		return world;
+	}
+
+	world.position = position;
+	world.rotation = rotation;
+	world.scale = scale;
+	world.parent = parent;
+	world.parent_version = parent_version;
+
 	if (!parent) {
-		return make_local_to_parent();
+		world.local_to_world = make_local_to_parent();
+		world.world_to_local = make_parent_to_local();
 	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		world.local_to_world = parent->world.local_to_world * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		world.world_to_local = make_parent_to_local() * glm::mat4(parent->world.world_to_local);
 	}
+
+	world.version += 1;
+	if (world.version == 0) world.version = 1; //(skip "never built" on wrap-around)
+
+	return world;
 }
-glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
+
+//-------------------------
+
+void Scene::PackedTransforms::build(std::list< Transform > const &list) {
+	transforms.clear();
+	parents.clear();
+	levels.clear();
+	slots.clear();
+
+	//compute depth of every transform (memoized, since parents may appear anywhere in the list):
+	std::unordered_map< Transform const *, uint32_t > depth;
+	depth.reserve(list.size());
+	std::function< uint32_t(Transform const *) > get_depth = [&](Transform const *t) -> uint32_t {
+		auto f = depth.find(t);
+		if (f != depth.end()) return f->second;
+		uint32_t d = (t->parent ? get_depth(t->parent) + 1 : 0);
+		depth.emplace(t, d);
+		return d;
+	};
+	uint32_t max_depth = 0;
+	for (auto const &t : list) {
+		max_depth = std::max(max_depth, get_depth(&t));
+	}
+
+	//counting sort by depth (stable, so list order is kept within each level):
+	if (!list.empty()) {
+		levels.assign(max_depth + 2, 0);
+		for (auto const &t : list) {
+			levels[depth.at(&t) + 1] += 1;
+		}
+		for (uint32_t d = 1; d < levels.size(); ++d) {
+			levels[d] += levels[d-1];
+		}
+	}
+
+	transforms.assign(list.size(), nullptr);
+	slots.reserve(list.size());
+	std::vector< uint32_t > next(levels.begin(), levels.end());
+	std::unordered_map< Transform const *, uint32_t > slot_of;
+	slot_of.reserve(list.size());
+	for (auto const &t : list) {
+		uint32_t slot = next[depth.at(&t)]++;
+		transforms[slot] = &t;
+		slots.emplace_back(slot);
+		slot_of.emplace(&t, slot);
+	}
+
+	parents.assign(transforms.size(), -1U);
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (transforms[i]->parent) {
+			auto f = slot_of.find(transforms[i]->parent);
+			if (f == slot_of.end()) {
+				throw std::runtime_error("transform '" + transforms[i]->name.str() + "' has a parent that is not in the same list.");
+			}
+			parents[i] = f->second;
+			assert(parents[i] < i);
+		}
+	}
+
+	positions.resize(transforms.size());
+	rotations.resize(transforms.size());
+	scales.resize(transforms.size());
+	local_to_world.resize(transforms.size());
+	world_to_local.resize(transforms.size());
+}
+
+void Scene::PackedTransforms::build(std::vector< Transform * > const &list, std::vector< uint32_t > const &children) {
+	transforms.clear();
+	parents.clear();
+	levels.clear();
+	slots.clear();
+
+	uint32_t count = uint32_t(list.size());
+	if (children.size() < size_t(count) + 1 || children[0] != 0 || children[count] != children.size() - (count + 1)) {
+		throw std::runtime_error("child table doesn't match transform list.");
+	}
+	uint32_t const *offsets = children.data();
+	uint32_t const *kids = children.data() + (count + 1);
+
+	//breadth-first from the roots gives each depth level in turn:
+	std::vector< uint32_t > order; //list index of the transform in each slot
+	order.reserve(count);
+	slots.assign(count, -1U);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (list[i]->parent) continue;
+		slots[i] = uint32_t(order.size());
+		order.emplace_back(i);
+		parents.emplace_back(-1U);
+	}
+	if (count != 0) {
+		levels.emplace_back(0);
+		levels.emplace_back(uint32_t(order.size()));
+	}
+	for (uint32_t begin = 0; begin < order.size(); /* later */) {
+		uint32_t end = uint32_t(order.size());
+		for (uint32_t slot = begin; slot < end; ++slot) {
+			uint32_t i = order[slot];
+			if (offsets[i] > offsets[i+1] || offsets[i+1] > children[count]) {
+				throw std::runtime_error("child table has invalid offsets.");
+			}
+			for (uint32_t k = offsets[i]; k < offsets[i+1]; ++k) {
+				uint32_t c = kids[k];
+				if (c >= count || slots[c] != -1U || list[c]->parent != list[i]) {
+					throw std::runtime_error("child table doesn't match transform hierarchy.");
+				}
+				slots[c] = uint32_t(order.size());
+				order.emplace_back(c);
+				parents.emplace_back(slot);
+			}
+		}
+		if (order.size() > end) levels.emplace_back(uint32_t(order.size()));
+		begin = end;
+	}
+	if (order.size() != count) {
+		throw std::runtime_error("child table doesn't reach every transform.");
+	}
+
+	transforms.resize(count);
+	for (uint32_t slot = 0; slot < count; ++slot) {
+		transforms[slot] = list[order[slot]];
+	}
+
+	positions.resize(count);
+	rotations.resize(count);
+	scales.resize(count);
+	local_to_world.resize(count);
+	world_to_local.resize(count);
+}
+
+bool Scene::PackedTransforms::pull(std::list< Transform > const &list) {
+	if (list.size() != slots.size()) return false;
+
+	//check that list still matches (only compares pointers, so is safe even if old transforms were erased):
+	uint32_t k = 0;
+	for (auto const &t : list) {
+		uint32_t slot = slots[k];
+		if (transforms[slot] != &t) return false;
+		uint32_t parent = parents[slot];
+		if (t.parent != (parent == -1U ? nullptr : transforms[parent])) return false;
+		++k;
+	}
+
+	k = 0;
+	for (auto const &t : list) {
+		uint32_t slot = slots[k];
+		positions[slot] = t.position;
+		rotations[slot] = t.rotation;
+		scales[slot] = t.scale;
+		++k;
+	}
+	return true;
+}
+
+void Scene::PackedTransforms::update(uint32_t begin, uint32_t end) {
+	assert(begin <= end && end <= transforms.size());
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::mat4x3 l2p = local_to_parent(positions[i], rotations[i], scales[i]);
+		glm::mat4x3 p2l = parent_to_local(positions[i], rotations[i], scales[i]);
+		uint32_t parent = parents[i];
+		if (parent == -1U) {
+			local_to_world[i] = l2p;
+			world_to_local[i] = p2l;
+		} else {
+			local_to_world[i] = local_to_world[parent] * glm::mat4(l2p);
+			world_to_local[i] = p2l * glm::mat4(world_to_local[parent]);
+		}
+	}
+}
+
+void Scene::PackedTransforms::push(uint32_t begin, uint32_t end) const {
+	assert(begin <= end && end <= transforms.size());
+	//slots are in depth order, so parents' versions are final before their children are checked:
+	for (uint32_t i = begin; i < end; ++i) {
+		Transform::WorldCache &world = transforms[i]->world;
+		uint32_t parent_version = (parents[i] == -1U ? 0 : transforms[parents[i]]->world.version);
+
+		//only touch caches that actually changed, so version numbers stay meaningful:
+		if (world.version != 0
+		 && world.parent == transforms[i]->parent
+		 && world.parent_version == parent_version
+		 && world.position == positions[i]
+		 && world.rotation == rotations[i]
+		 && world.scale == scales[i]) {
+			continue;
+		}
+
+		world.position = positions[i];
+		world.rotation = rotations[i];
+		world.scale = scales[i];
+		world.parent = transforms[i]->parent;
+		world.parent_version = parent_version;
+		world.local_to_world = local_to_world[i];
+		world.world_to_local = world_to_local[i];
+		world.version += 1;
+		if (world.version == 0) world.version = 1;
+	}
+}
+
+void Scene::update_world_matrices() {
+	if (!packed_transforms.pull(transforms)) {
+		packed_transforms.build(transforms);
+		bool pulled = packed_transforms.pull(transforms);
+		assert(pulled);
+		(void)pulled; //(silence unused variable warning in release builds)
+	}
+	packed_transforms.update();
+	packed_transforms.push();
+}
+
+void Scene::update_world_matrices(ThreadPool &pool) {
+	if (!packed_transforms.pull(transforms)) {
+		packed_transforms.build(transforms);
+		bool pulled = packed_transforms.pull(transforms);
+		assert(pulled);
+		(void)pulled;
+	}
+
+	//transforms within a depth level only depend on earlier levels, so each level can be split freely:
+	// (small batches aren't worth the synchronization, hence min_batch)
+	std::vector< uint32_t > const &levels = packed_transforms.levels;
+	for (uint32_t d = 0; d + 1 < levels.size(); ++d) {
+		pool.parallel_for(levels[d+1] - levels[d], [this,&levels,d](uint32_t begin, uint32_t end){
+			packed_transforms.update(levels[d] + begin, levels[d] + end);
+			packed_transforms.push(levels[d] + begin, levels[d] + end);
+		}, 256);
+	}
+}
+
+//-------------------------
+
+void Scene::Drawable::set_mesh(Mesh const &mesh) {
+	pipeline.type = mesh.type;
+	pipeline.start = mesh.start;
+	pipeline.count = mesh.count;
+	pipeline.index_type = mesh.index_type;
+	min = mesh.min;
+	max = mesh.max;
+	position_offset = mesh.position_offset;
+	position_scale = mesh.position_scale;
+	lod_count = 0;
+	current_lod = 0;
+}
+
+void Scene::Drawable::set_mesh_lods(MeshBuffer const &buffer, std::string const &name, float lod0_min_size) {
+	Mesh const *lod0 = buffer.find(name);
+	if (!lod0) lod0 = &buffer.lookup(name + "_LOD0");
+	set_mesh(*lod0);
+
+	float min_size = lod0_min_size;
+	for (Mesh const *mesh = lod0; mesh && lod_count < MaxLODs; mesh = buffer.find(name + "_LOD" + std::to_string(lod_count))) {
+		if (mesh->type != lod0->type || mesh->index_type != lod0->index_type) {
+			throw std::runtime_error("Level of detail '" + name + "_LOD" + std::to_string(lod_count) + "' has a different primitive or index type than '" + name + "'.");
+		}
+		lods[lod_count].start = mesh->start;
+		lods[lod_count].count = mesh->count;
+		lods[lod_count].min_size = min_size;
+		lods[lod_count].position_offset = mesh->position_offset;
+		lods[lod_count].position_scale = mesh->position_scale;
+		min_size *= 0.5f;
+		lod_count += 1;
+	}
+	//a single level doesn't need selecting:
+	if (lod_count == 1) lod_count = 0;
+}
+
+//find the slot for 'location' (or a free one) and fill it in:
+static void store_uniform(Scene::Drawable::Pipeline &pipeline, GLuint location, GLenum type, void const *data, size_t size) {
+	if (location == -1U) return;
+	Scene::Drawable::Pipeline::Uniform *slot = nullptr;
+	for (auto &uniform : pipeline.uniforms) {
+		if (uniform.type != GL_NONE && uniform.location == location) {
+			slot = &uniform;
+			break;
+		}
+		if (uniform.type == GL_NONE && !slot) slot = &uniform;
+	}
+	if (!slot) throw std::runtime_error("Pipeline already has " + std::to_string(Scene::Drawable::Pipeline::UniformCount) + " uniforms set.");
+	slot->location = location;
+	slot->type = type;
+	slot->value = {};
+	std::memcpy(&slot->value, data, size);
+}
+
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, float value) {
+	store_uniform(*this, location, GL_FLOAT, &value, sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::vec2 const &value) {
+	store_uniform(*this, location, GL_FLOAT_VEC2, glm::value_ptr(value), sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::vec3 const &value) {
+	store_uniform(*this, location, GL_FLOAT_VEC3, glm::value_ptr(value), sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::vec4 const &value) {
+	store_uniform(*this, location, GL_FLOAT_VEC4, glm::value_ptr(value), sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, GLint value) {
+	store_uniform(*this, location, GL_INT, &value, sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::ivec2 const &value) {
+	store_uniform(*this, location, GL_INT_VEC2, glm::value_ptr(value), sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::ivec3 const &value) {
+	store_uniform(*this, location, GL_INT_VEC3, glm::value_ptr(value), sizeof(value));
+}
+void Scene::Drawable::Pipeline::set_uniform(GLuint location, glm::ivec4 const &value) {
+	store_uniform(*this, location, GL_INT_VEC4, glm::value_ptr(value), sizeof(value));
+}
+
+//send a pipeline's stored uniform values to the currently bound program:
+static void apply_uniforms(Scene::Drawable::Pipeline const &pipeline) {
+	for (auto const &uniform : pipeline.uniforms) {
+		switch (uniform.type) {
+			case GL_FLOAT: glUniform1fv(uniform.location, 1, uniform.value.f); break;
+			case GL_FLOAT_VEC2: glUniform2fv(uniform.location, 1, uniform.value.f); break;
+			case GL_FLOAT_VEC3: glUniform3fv(uniform.location, 1, uniform.value.f); break;
+			case GL_FLOAT_VEC4: glUniform4fv(uniform.location, 1, uniform.value.f); break;
+			case GL_INT: glUniform1iv(uniform.location, 1, uniform.value.i); break;
+			case GL_INT_VEC2: glUniform2iv(uniform.location, 1, uniform.value.i); break;
+			case GL_INT_VEC3: glUniform3iv(uniform.location, 1, uniform.value.i); break;
+			case GL_INT_VEC4: glUniform4iv(uniform.location, 1, uniform.value.i); break;
+			default: break; //GL_NONE -- unused slot
+		}
+	}
+}
+
+//do two pipelines store the same uniform values?
+static bool same_uniforms(Scene::Drawable::Pipeline const &a, Scene::Drawable::Pipeline const &b) {
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::UniformCount; ++i) {
+		auto const &ua = a.uniforms[i];
+		auto const &ub = b.uniforms[i];
+		if (ua.type != ub.type) return false;
+		if (ua.type == GL_NONE) continue;
+		if (ua.location != ub.location || std::memcmp(&ua.value, &ub.value, sizeof(ua.value)) != 0) return false;
+	}
+	return true;
+}
+
+//does the drawable have bounds? (drawables with empty -- min > max -- bounds are never culled)
+static bool has_bounds(Scene::Drawable const &drawable) {
+	return drawable.min.x <= drawable.max.x && drawable.min.y <= drawable.max.y && drawable.min.z <= drawable.max.z;
+}
+
+//world-space bounds of a drawable:
+static BVH::Box world_bounds(Scene::Drawable const &drawable) {
+	glm::mat4x3 const &local_to_world = drawable.transform->update_world().local_to_world;
+	glm::vec3 center = 0.5f * (drawable.max + drawable.min);
+	glm::vec3 radius = 0.5f * (drawable.max - drawable.min);
+
+	//box of the transformed box (extent along each world axis is a sum of absolute values):
+	glm::vec3 world_center = local_to_world * glm::vec4(center, 1.0f);
+	glm::vec3 world_radius = glm::abs(local_to_world[0]) * radius.x
+	                       + glm::abs(local_to_world[1]) * radius.y
+	                       + glm::abs(local_to_world[2]) * radius.z;
+	BVH::Box box;
+	box.min = world_center - world_radius;
+	box.max = world_center + world_radius;
+	return box;
+}
+
+void Scene::update_bvh() {
+	//gather drawables (keeping unbounded ones out of the hierarchy):
+	std::vector< Drawable * > bounded;
+	bounded.reserve(drawables.size());
+	unbounded_drawables.clear();
+	for (auto &drawable : drawables) {
+		if (drawable.octree_item != -1U) continue; //(octree_drawables are handled by update_octree())
+		if (has_bounds(drawable)) {
+			bounded.emplace_back(&drawable);
+		} else {
+			unbounded_drawables.emplace_back(&drawable);
+		}
+	}
+
+	std::vector< BVH::Box > boxes;
+	boxes.reserve(bounded.size());
+	for (Drawable *drawable : bounded) {
+		boxes.emplace_back(world_bounds(*drawable));
+	}
+
+	//same drawables as last time? refit (and only rebuild if the tree has gotten bad):
+	if (bounded == bvh_drawables) {
+		bvh.refit(boxes);
+		if (bvh.degraded()) bvh.build(boxes);
 	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		bvh_drawables = std::move(bounded);
+		bvh.build(boxes);
+	}
+
+	//note what the bvh was built from (world_bounds() brought the world matrices up to date):
+	bvh_generation = Drawable::generation.load(std::memory_order_relaxed);
+	bvh_drawable_count = drawables.size();
+	bvh_versions.clear();
+	bvh_versions.reserve(bvh_drawables.size());
+	for (Drawable const *drawable : bvh_drawables) {
+		bvh_versions.emplace_back(drawable->transform->world.version);
+	}
+}
+
+bool Scene::bvh_current() const {
+	//drawables created or destroyed since update_bvh()? then bvh_drawables may point at dead drawables:
+	if (bvh_generation == 0) return false;
+	if (Drawable::generation.load(std::memory_order_relaxed) != bvh_generation) return false;
+	if (drawables.size() != bvh_drawable_count) return false; //(catches drawables spliced in or out)
+
+	//make sure none of the transforms the bvh and octree depend on have moved:
+	for (uint32_t i = 0; i < bvh_drawables.size(); ++i) {
+		if (bvh_drawables[i]->transform->update_world().version != bvh_versions[i]) return false;
+	}
+	for (OctreeDrawable const &entry : octree_drawables) {
+		if (entry.drawable->transform->update_world().version != entry.version) return false;
+	}
+	return true;
+}
+
+void Scene::add_to_octree(Drawable *drawable) {
+	assert(drawable);
+	if (drawable->octree_item != -1U) return; //already there
+	if (!has_bounds(*drawable)) {
+		throw std::runtime_error("Only drawables with bounds can be added to the octree.");
+	}
+
+	bvh_generation = 0; //(drawable is still in the bvh until the next update_bvh())
+
+	drawable->octree_item = uint32_t(octree_drawables.size());
+	octree_drawables.emplace_back(OctreeDrawable{drawable, drawable->transform->update_world().version});
+	BVH::Box box = world_bounds(*drawable);
+	octree.insert(drawable->octree_item, box.min, box.max);
+}
+
+void Scene::remove_from_octree(Drawable *drawable) {
+	assert(drawable);
+	uint32_t item = drawable->octree_item;
+	if (item == -1U) return; //not there
+	assert(item < octree_drawables.size() && octree_drawables[item].drawable == drawable);
+
+	bvh_generation = 0; //(drawable isn't in the bvh until the next update_bvh())
+
+	octree.remove(item);
+	drawable->octree_item = -1U;
+
+	//keep items dense by moving the last item into the hole:
+	uint32_t last = uint32_t(octree_drawables.size()) - 1;
+	if (item != last) {
+		LooseOctree::Item moved = octree.items[last];
+		octree.remove(last);
+		octree.insert(item, moved.min, moved.max);
+		octree_drawables[item] = octree_drawables[last];
+		octree_drawables[item].drawable->octree_item = item;
+	}
+	octree_drawables.pop_back();
+}
+
+void Scene::update_octree() {
+	for (uint32_t i = 0; i < octree_drawables.size(); ++i) {
+		OctreeDrawable &entry = octree_drawables[i];
+		uint32_t version = entry.drawable->transform->update_world().version;
+		if (version == entry.version) continue; //hasn't moved
+		entry.version = version;
+		BVH::Box box = world_bounds(*entry.drawable);
+		octree.update(i, box.min, box.max);
+	}
+}
+
+//does the ray origin + t * direction (given 1 / direction) hit the box? if so, *enter is the (non-negative) t where it enters:
+static bool ray_hits_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max, float *enter) {
+	//slab test:
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 t_min = glm::min(t0, t1);
+	glm::vec3 t_max = glm::max(t0, t1);
+	*enter = std::max(0.0f, std::max(t_min.x, std::max(t_min.y, t_min.z)));
+	float exit = std::min(t_max.x, std::min(t_max.y, t_max.z));
+	return *enter <= exit;
+}
+
+Scene::Drawable *Scene::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float *t, float max_t) const {
+	float hit_t = max_t;
+	Drawable *ret = nullptr;
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	if (bvh_current()) {
+		uint32_t hit = bvh.raycast(origin, direction, max_t, &hit_t);
+		if (hit != -1U) ret = bvh_drawables[hit];
+
+		//octree drawables are checked one at a time (there shouldn't be too many of them):
+		for (OctreeDrawable const &entry : octree_drawables) {
+			LooseOctree::Item const &item = octree.items[entry.drawable->octree_item];
+			float enter;
+			if (ray_hits_box(origin, inv_direction, item.min, item.max, &enter) && enter <= hit_t) {
+				hit_t = enter;
+				ret = entry.drawable;
+			}
+		}
+	} else {
+		//bvh or octree is out of date, so check every drawable:
+		for (Drawable const &drawable : drawables) {
+			if (!has_bounds(drawable)) continue;
+			BVH::Box box = world_bounds(drawable);
+			float enter;
+			if (ray_hits_box(origin, inv_direction, box.min, box.max, &enter) && enter <= hit_t) {
+				hit_t = enter;
+				ret = const_cast< Drawable * >(&drawable); //(same as the pointers in bvh_drawables, which aren't const either)
+			}
+		}
+	}
+
+	if (ret && t) *t = hit_t;
+	return ret;
+}
+
+void Scene::query_aabb(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable * > *out) const {
+	assert(out);
+	if (!bvh_current()) {
+		//bvh or octree is out of date, so check every drawable:
+		for (Drawable const &drawable : drawables) {
+			if (!has_bounds(drawable)) continue;
+			BVH::Box box = world_bounds(drawable);
+			if (glm::all(glm::lessThanEqual(box.min, max)) && glm::all(glm::lessThanEqual(min, box.max))) {
+				out->emplace_back(const_cast< Drawable * >(&drawable));
+			}
+		}
+		return;
+	}
+
+	std::vector< uint32_t > hits;
+	bvh.query_box(min, max, &hits);
+	for (uint32_t i : hits) {
+		out->emplace_back(bvh_drawables[i]);
+	}
+	hits.clear();
+	octree.query_box(min, max, &hits);
+	for (uint32_t i : hits) {
+		out->emplace_back(octree_drawables[i].drawable);
+	}
+}
+
+void Scene::query_sphere(glm::vec3 const &center, float radius, std::vector< Drawable * > *out) const {
+	assert(out);
+	auto box_in_sphere = [&](glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 to_closest = glm::clamp(center, min, max) - center;
+		return glm::dot(to_closest, to_closest) <= radius * radius;
+	};
+
+	if (!bvh_current()) {
+		//bvh or octree is out of date, so check every drawable:
+		for (Drawable const &drawable : drawables) {
+			if (!has_bounds(drawable)) continue;
+			BVH::Box box = world_bounds(drawable);
+			if (box_in_sphere(box.min, box.max)) {
+				out->emplace_back(const_cast< Drawable * >(&drawable));
+			}
+		}
+		return;
+	}
+
+	std::vector< uint32_t > hits;
+	//the bvh only does boxes, so check its results against the sphere:
+	bvh.query_box(center - glm::vec3(radius), center + glm::vec3(radius), &hits);
+	for (uint32_t i : hits) {
+		BVH::Box const &box = bvh.boxes[i];
+		if (box_in_sphere(box.min, box.max)) {
+			out->emplace_back(bvh_drawables[i]);
+		}
+	}
+	hits.clear();
+	octree.query_sphere(center, radius, &hits);
+	for (uint32_t i : hits) {
+		out->emplace_back(octree_drawables[i].drawable);
 	}
 }
 
@@ -80,6 +702,126 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+//check if (any part of) a box might be visible given its object-to-clip matrix:
+// returns true for empty (min > max) boxes, since their contents are unknown
+static bool box_in_frustum(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) return true;
+
+	glm::vec4 planes[5];
+	frustum_planes(object_to_clip, planes);
+	return classify_box(planes, 5, min, max) >= 0;
+}
+
+//Instance data for batched draws is streamed through this buffer, which shaders see as a buffer texture:
+static GLuint instance_buffer = 0;
+static GLuint instance_buffer_texture = 0;
+
+static Load< void > setup_instance_buffer(LoadTagDefault, [](){
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, instance_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_STREAM_DRAW); //(filled by draw())
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &instance_buffer_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, instance_buffer_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instance_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS();
+});
+
+//Per-drawable matrices for programs with Pipeline::uses_object_block, in std140 layout:
+struct ObjectBlock {
+	glm::mat4 OBJECT_TO_CLIP;
+	glm::vec4 OBJECT_TO_LIGHT[4]; //mat4x3 -- std140 pads each column to a vec4
+	glm::vec4 NORMAL_TO_LIGHT[3]; //mat3 -- same padding
+};
+static_assert(sizeof(ObjectBlock) == 64 + 64 + 48, "ObjectBlock matches std140 layout.");
+
+//All of a frame's ObjectBlocks are uploaded into this buffer at once (orphaning the previous frame's storage):
+static GLuint object_buffer = 0;
+static GLsizeiptr object_block_stride = 0; //sizeof(ObjectBlock) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+static Load< void > setup_object_buffer(LoadTagDefault, [](){
+	glGenBuffers(1, &object_buffer);
+
+	GLint alignment = 256; //(largest alignment required in practice)
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	object_block_stride = (GLsizeiptr(sizeof(ObjectBlock)) + alignment - 1) / alignment * alignment;
+
+	GL_ERRORS();
+});
+
+//can drawables with this pipeline be drawn as instances?
+// (uniform locations refer to 'program', so drawables that set uniforms are never instanced)
+static bool instanceable(Scene::Drawable::Pipeline const &pipeline) {
+	if (pipeline.instanced_program == 0 || pipeline.set_uniforms) return false;
+	for (auto const &uniform : pipeline.uniforms) {
+		if (uniform.type != GL_NONE) return false;
+	}
+	return true;
+}
+
+//can these commands be drawn as instances of one draw call?
+static bool can_instance(Scene::DrawCommand const &ca, Scene::DrawCommand const &cb) {
+	Scene::Drawable::Pipeline const &a = ca.drawable->pipeline;
+	Scene::Drawable::Pipeline const &b = cb.drawable->pipeline;
+	if (!instanceable(a) || !instanceable(b)) return false;
+	if (a.program != b.program || a.instanced_program != b.instanced_program) return false;
+	if (a.vao != b.vao || a.type != b.type || a.index_type != b.index_type || ca.start != cb.start || ca.count != cb.count) return false;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (a.textures[i].texture != b.textures[i].texture || a.textures[i].target != b.textures[i].target) return false;
+	}
+	return true;
+}
+
+//Sort key (DrawCommand::key) that groups drawables by program, then vertex array, then textures, then front-to-back depth:
+// bits 63-54: program, 53-42: vao, 41-26: textures (hashed), 25-0: depth
+// (names are truncated or hashed, so unrelated state can collide -- this only affects ordering, since replay() still compares the actual state)
+//Drawables that could be instanced use their vertex range in place of depth, so copies of a mesh end up next to each other.
+static uint64_t make_sort_key(Scene::Drawable::Pipeline const &pipeline, GLuint start, GLuint count, float depth) {
+	uint64_t textures = 0;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		textures = textures * 0x9E3779B1ULL + pipeline.textures[i].texture;
+	}
+	textures ^= (textures >> 32);
+
+	uint64_t low = 0;
+	if (instanceable(pipeline)) {
+		uint64_t range = (uint64_t(start) * 0x9E3779B1ULL) ^ count ^ (uint64_t(pipeline.type) << 20);
+		low = (range ^ (range >> 26)) & 0x3ffffff;
+	} else {
+		//non-negative floats sort the same way as their bit patterns, so keep the high bits of the depth:
+		uint32_t depth_bits = 0;
+		if (depth > 0.0f) {
+			static_assert(sizeof(depth) == sizeof(depth_bits), "float is 32 bits");
+			std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+		}
+		low = depth_bits >> 6;
+	}
+
+	return (uint64_t(pipeline.program & 0x3ff) << 54)
+	     | (uint64_t(pipeline.vao & 0xfff) << 42)
+	     | ((textures & 0xffff) << 26)
+	     | low;
+}
+
+//Levels of detail switch once the projected size is this fraction past a threshold:
+// (so drawables sitting right at a threshold don't flicker between levels)
+static constexpr float LODHysteresis = 0.1f;
+
+//pick a level of detail for a drawable with the given projected size, starting from the level drawn last time:
+static uint32_t select_lod(Scene::Drawable const &drawable, float size) {
+	assert(drawable.lod_count > 0 && drawable.lod_count <= Scene::Drawable::MaxLODs);
+	uint32_t lod = std::min(drawable.current_lod, drawable.lod_count - 1);
+	//coarser, once clearly smaller than this level's threshold:
+	while (lod + 1 < drawable.lod_count && size < drawable.lods[lod].min_size * (1.0f - LODHysteresis)) ++lod;
+	//finer, once clearly larger than the next-finer level's threshold:
+	while (lod > 0 && size > drawable.lods[lod-1].min_size * (1.0f + LODHysteresis)) --lod;
+	return lod;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
@@ -88,75 +830,336 @@ void Scene::draw(Camera const &camera) const {
 }
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	std::vector< DrawCommand > commands;
+	record(world_to_clip, world_to_light, &commands);
+	replay(commands);
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+void Scene::record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, std::vector< DrawCommand > *commands_, ThreadPool *pool) const {
+	assert(commands_);
+	auto &commands = *commands_;
+	commands.clear();
+
+	//normals go from world to light space by the inverse transpose of world_to_light:
+	// (combined with each transform's cached normal_to_world below, this avoids a per-drawable inverse)
+	glm::mat3 normal_world_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+
+	//world-space lengths (at distance w) become fractions of the viewport height by multiplying by lod_scale / w:
+	// (length of the clip-space y row; for a perspective camera this is the projection's y scale)
+	float lod_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	draw_stats.visible = 0;
+	draw_stats.culled = 0;
+
+	//Figure out which drawables to consider:
+	std::vector< Drawable const * > candidates;
+	candidates.reserve(drawables.size());
+
+	//if the bvh and octree are up to date with the drawables, use them to cull whole groups of drawables at once:
+	if (bvh_current()) {
+		glm::vec4 planes[5];
+		frustum_planes(world_to_clip, planes);
+		std::vector< uint32_t > inside;
+		bvh.query_planes(planes, 5, &inside);
+		draw_stats.culled = uint32_t(bvh_drawables.size() - inside.size());
+		for (uint32_t i : inside) {
+			candidates.emplace_back(bvh_drawables[i]);
+		}
+		inside.clear();
+		octree.query_planes(planes, 5, &inside);
+		draw_stats.culled += uint32_t(octree_drawables.size() - inside.size());
+		for (uint32_t i : inside) {
+			candidates.emplace_back(octree_drawables[i].drawable);
+		}
+		candidates.insert(candidates.end(), unbounded_drawables.begin(), unbounded_drawables.end());
+	} else {
+		for (auto const &drawable : drawables) {
+			candidates.emplace_back(&drawable);
+		}
+	}
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+	//Bring world matrices up to date first, since transforms can be shared (and their caches aren't thread-safe):
+	for (Drawable const *candidate : candidates) {
+		assert(candidate->transform); //drawables *must* have a transform
+		candidate->transform->update_world();
+	}
 
+	//Write a command for each candidate, noting whether it is visible:
+	enum : uint8_t { Skipped, Culled, Visible };
+	std::vector< uint8_t > results(candidates.size(), Skipped);
+	commands.resize(candidates.size());
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+	auto record_range = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			Drawable const &drawable = *candidates[i];
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+			//Reference to drawable's pipeline for convenience:
+			Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
-		//Configure program uniforms:
+			//skip any drawables without a shader program set:
+			if (pipeline.program == 0) continue;
+			//skip any drawables that don't reference any vertex array:
+			if (pipeline.vao == 0) continue;
+			//skip any drawables that don't contain any vertices:
+			if (pipeline.count == 0) continue;
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			//the object-to-world matrix is used for culling and in all three of the matrices below:
+			// (already updated, so only read the cache here)
+			Transform::WorldCache const &world = drawable.transform->world;
+			glm::mat4x3 const &object_to_world = world.local_to_world;
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
 			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+
+			//skip any drawables whose bounds are entirely outside the view frustum:
+			// (the bvh tests world-space boxes, so this tighter local-space test can still cull more)
+			if (!box_in_frustum(object_to_clip, drawable.min, drawable.max)) {
+				results[i] = Culled;
+				continue;
+			}
+			results[i] = Visible;
+
+			DrawCommand &command = commands[i];
+			command.drawable = &drawable;
+			command.object_to_clip = object_to_clip;
+
+			//OBJECT_TO_LIGHT takes vertices from object space to light space:
+			command.object_to_light = world_to_light * glm::mat4(object_to_world);
+
+			//NORMAL_TO_LIGHT takes normals from object space to light space:
+			command.normal_to_light = normal_world_to_light * glm::transpose(glm::mat3(world.world_to_local));
+
+			//depth of the bounds' center (or the transform's origin, if bounds are unknown):
+			glm::vec3 center = glm::vec3(0.0f);
+			if (drawable.min.x <= drawable.max.x) center = 0.5f * (drawable.min + drawable.max);
+			float depth = (object_to_clip * glm::vec4(center, 1.0f)).w;
+
+			//pick a vertex range, using the projected size of the bounds to choose a level of detail:
+			command.start = pipeline.start;
+			command.count = pipeline.count;
+			glm::vec3 const *position_offset = &drawable.position_offset;
+			glm::vec3 const *position_scale = &drawable.position_scale;
+			if (drawable.lod_count > 0) {
+				uint32_t lod = 0;
+				if (drawable.min.x <= drawable.max.x) {
+					//bounding sphere radius, scaled by the largest axis scale of the transform:
+					float scale2 = std::max(glm::dot(object_to_world[0], object_to_world[0]), std::max(
+						glm::dot(object_to_world[1], object_to_world[1]), glm::dot(object_to_world[2], object_to_world[2])));
+					float radius = 0.5f * glm::length(drawable.max - drawable.min) * std::sqrt(scale2);
+					//(viewer inside the bounding sphere counts as infinitely large)
+					float size = (depth > radius ? radius * lod_scale / depth : std::numeric_limits< float >::infinity());
+					lod = select_lod(drawable, size);
+				}
+				if (lod != drawable.current_lod) drawable.current_lod = lod; //(only one thread records each drawable)
+				command.start = drawable.lods[lod].start;
+				command.count = drawable.lods[lod].count;
+				position_offset = &drawable.lods[lod].position_offset;
+				position_scale = &drawable.lods[lod].position_scale;
+			}
+
+			//(quantized) vertex positions need mapping to local space before the object matrices:
+			// (normals are stored as they are, so NORMAL_TO_LIGHT is unchanged)
+			if (*position_scale != glm::vec3(1.0f) || *position_offset != glm::vec3(0.0f)) {
+				glm::mat4 position_to_local = glm::mat4(
+					glm::vec4(position_scale->x, 0.0f, 0.0f, 0.0f),
+					glm::vec4(0.0f, position_scale->y, 0.0f, 0.0f),
+					glm::vec4(0.0f, 0.0f, position_scale->z, 0.0f),
+					glm::vec4(*position_offset, 1.0f)
+				);
+				command.object_to_clip = command.object_to_clip * position_to_local;
+				command.object_to_light = command.object_to_light * position_to_local;
+			}
+
+			command.key = make_sort_key(pipeline, command.start, command.count, depth);
 		}
+	};
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	if (pool) {
+		pool->parallel_for(uint32_t(candidates.size()), record_range, 256);
+	} else {
+		record_range(0, uint32_t(candidates.size()));
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//Keep only the visible commands:
+	size_t visible = 0;
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		if (results[i] == Visible) {
+			if (visible != i) commands[visible] = commands[i];
+			++visible;
+		} else if (results[i] == Culled) {
+			draw_stats.culled += 1;
 		}
+	}
+	commands.resize(visible);
+	draw_stats.visible = uint32_t(visible);
+
+	//Sort so that drawables sharing state end up next to each other (and are drawn roughly front-to-back):
+	std::sort(commands.begin(), commands.end(), [](DrawCommand const &a, DrawCommand const &b){
+		return a.key < b.key;
+	});
+}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+void Scene::replay(std::vector< DrawCommand > const &commands) const {
+	draw_stats.draw_calls = 0;
+
+	//Split the commands into runs that can be drawn with one (instanced) draw call:
+	std::vector< size_t > run_ends;
+	run_ends.reserve(commands.size());
+	for (size_t q = 0; q < commands.size(); /* later */) {
+		size_t end = q + 1;
+		while (end < commands.size() && can_instance(commands[q], commands[end])) {
+			++end;
 		}
+		run_ends.emplace_back(end);
+		q = end;
+	}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+	//Write the matrices for all non-instanced drawables that use the Object block into one upload:
+	std::vector< uint8_t > object_data;
+	for (size_t r = 0, q = 0; r < run_ends.size(); q = run_ends[r], ++r) {
+		if (run_ends[r] - q >= 2 || !commands[q].drawable->pipeline.uses_object_block) continue;
+		DrawCommand const &command = commands[q];
+		object_data.resize(object_data.size() + object_block_stride);
+		ObjectBlock &block = *reinterpret_cast< ObjectBlock * >(object_data.data() + object_data.size() - object_block_stride);
+		block.OBJECT_TO_CLIP = command.object_to_clip;
+		for (uint32_t c = 0; c < 4; ++c) block.OBJECT_TO_LIGHT[c] = glm::vec4(command.object_to_light[c], 0.0f);
+		for (uint32_t c = 0; c < 3; ++c) block.NORMAL_TO_LIGHT[c] = glm::vec4(command.normal_to_light[c], 0.0f);
+	}
+	if (!object_data.empty()) {
+		glBindBuffer(GL_UNIFORM_BUFFER, object_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, object_data.size(), object_data.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	GLintptr object_offset = 0;
+
+	//Send the commands to OpenGL, only changing state when it differs from the previous drawable:
+	GLuint current_program = 0;
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+	uint32_t current_unit = 0;
+	bool instance_data_bound = false;
+	Drawable::Pipeline const *uniforms_from = nullptr; //pipeline whose stored uniforms were set most recently
+
+	//instance data for the current batch:
+	std::vector< glm::vec4 > instance_data;
+
+	for (size_t r = 0, q = 0; r < run_ends.size(); q = run_ends[r], ++r) {
+		size_t end = run_ends[r];
+		Scene::Drawable::Pipeline const &pipeline = commands[q].drawable->pipeline;
+		bool instanced = (end - q >= 2);
+
+		//Set shader program:
+		GLuint program = (instanced ? pipeline.instanced_program : pipeline.program);
+		if (program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+		}
+
+		//Set attribute sources:
+		if (pipeline.vao != current_vao) {
+			glBindVertexArray(pipeline.vao);
+			current_vao = pipeline.vao;
+		}
+
+		//Configure program uniforms:
+		if (instanced) {
+			//pack matrices for every instance (layout described with Pipeline::instanced_program):
+			instance_data.clear();
+			instance_data.reserve((end - q) * 11);
+			for (size_t i = q; i < end; ++i) {
+				DrawCommand const &command = commands[i];
+				for (uint32_t c = 0; c < 4; ++c) instance_data.emplace_back(command.object_to_clip[c]);
+				for (uint32_t c = 0; c < 4; ++c) instance_data.emplace_back(command.object_to_light[c], 0.0f);
+				for (uint32_t c = 0; c < 3; ++c) instance_data.emplace_back(command.normal_to_light[c], 0.0f);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, instance_buffer);
+			glBufferData(GL_TEXTURE_BUFFER, instance_data.size() * sizeof(glm::vec4), instance_data.data(), GL_STREAM_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+			if (!instance_data_bound) {
+				glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceDataUnit);
+				current_unit = Drawable::Pipeline::InstanceDataUnit;
+				glBindTexture(GL_TEXTURE_BUFFER, instance_buffer_texture);
+				instance_data_bound = true;
+			}
+		} else {
+			DrawCommand const &command = commands[q];
+			if (pipeline.uses_object_block) {
+				//select this drawable's block (written above, in the same order):
+				glBindBufferRange(GL_UNIFORM_BUFFER, Drawable::Pipeline::ObjectBlockBinding, object_buffer, object_offset, sizeof(ObjectBlock));
+				object_offset += object_block_stride;
+			} else {
+				if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+					glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(command.object_to_clip));
+				}
+				if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+					glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(command.object_to_light));
+				}
+				if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+					glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(command.normal_to_light));
+				}
+			}
+
+			//set stored uniforms (unless the previous drawable already set the same values for this program):
+			if (!(uniforms_from && uniforms_from->program == pipeline.program && same_uniforms(*uniforms_from, pipeline))) {
+				apply_uniforms(pipeline);
+				uniforms_from = &pipeline;
+			}
+
+			//set any requested custom uniforms:
+			// (this could change anything, so stored uniforms will be set again for the next drawable)
+			if (pipeline.set_uniforms) {
+				pipeline.set_uniforms();
+				uniforms_from = nullptr;
+			}
+		}
 
 		//set up textures:
+		// (units the pipeline doesn't use keep whatever was bound, since its program won't sample them)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
+			Drawable::Pipeline::TextureInfo const &info = pipeline.textures[i];
+			if (info.texture == 0) continue;
+			if (info.texture == current_textures[i].texture && info.target == current_textures[i].target) continue;
+			if (current_unit != i) {
 				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+				current_unit = i;
 			}
+			glBindTexture(info.target, info.texture);
+			current_textures[i] = info;
 		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+		//draw the object(s):
+		if (pipeline.index_type != GL_NONE) {
+			GLsizei index_size = (pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			GLbyte const *offset = (GLbyte const *)0 + size_t(commands[q].start) * index_size;
+			if (instanced) {
+				glDrawElementsInstanced(pipeline.type, commands[q].count, pipeline.index_type, offset, GLsizei(end - q));
+			} else {
+				glDrawElements(pipeline.type, commands[q].count, pipeline.index_type, offset);
 			}
+		} else if (instanced) {
+			glDrawArraysInstanced(pipeline.type, commands[q].start, commands[q].count, GLsizei(end - q));
+		} else {
+			glDrawArrays(pipeline.type, commands[q].start, commands[q].count);
 		}
-		glActiveTexture(GL_TEXTURE0);
+		draw_stats.draw_calls += 1;
+	}
+	assert(object_offset == GLintptr(object_data.size()));
 
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(current_textures[i].target, 0);
+		}
+	}
+	if (instance_data_bound) {
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceDataUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	if (object_offset != 0) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, Drawable::Pipeline::ObjectBlockBinding, 0);
 	}
 
 	glUseProgram(0);
@@ -169,10 +1172,69 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//the file is parsed in place, directly from the mapping:
+	MappedFile file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	std::vector< Transform * > hierarchy_transforms;
+	std::vector< char > str0;
+	char const *at = load_chunks(file, filename, [&](Transform *transform, std::string const &mesh_name, glm::vec3 const &min, glm::vec3 const &max) {
+		if (on_drawable) {
+			size_t before = drawables.size();
+			on_drawable(*this, transform, mesh_name);
+			set_new_drawable_bounds(before, min, max);
+		}
+	}, &hierarchy_transforms, &str0);
+
+	//load any extra that a subclass wants:
+	// (load_extra reads the rest of the mapping as a stream)
+	MemoryStream rest(at, file.data + file.size);
+	load_extra(rest, str0, hierarchy_transforms);
+
+	if (rest.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+	}
+
+	update_name_index();
+}
+
+void Scene::set_new_drawable_bounds(size_t before, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!(min.x <= max.x)) return;
+	auto d = drawables.rbegin();
+	for (size_t i = before; i < drawables.size(); ++i, ++d) {
+		if (!(d->min.x <= d->max.x)) {
+			d->min = min;
+			d->max = max;
+		}
+	}
+}
+
+#ifndef NDEBUG
+//used to sanity-check stored world matrices (which go through a different order of float operations than update_world):
+static bool close_to(glm::mat4x3 const &a, glm::mat4x3 const &b) {
+	for (uint32_t c = 0; c < 4; ++c) {
+		for (uint32_t r = 0; r < 3; ++r) {
+			if (std::abs(a[c][r] - b[c][r]) > 1e-3f * (1.0f + std::abs(b[c][r]))) return false;
+		}
+	}
+	return true;
+}
+#endif
+
+char const *Scene::load_chunks(MappedFile const &file, std::string const &filename,
+	std::function< void(Transform *, std::string const &, glm::vec3 const &, glm::vec3 const &) > const &on_mesh,
+	std::vector< Transform * > *hierarchy_transforms_, std::vector< char > *str0) {
+	assert(hierarchy_transforms_);
+	assert(str0);
+	auto &hierarchy_transforms = *hierarchy_transforms_;
+
+	char const *at = file.data;
+	char const *end = file.data + file.size;
+
+	ChunkView< char > names = view_chunk< char >(&at, end, "str0");
+	//names are referenced as views into the mapping:
+	auto name_view = [&names](uint32_t name_begin, uint32_t name_end) {
+		return std::string_view(names.data + name_begin, name_end - name_begin);
+	};
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +1245,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkView< HierarchyEntry > hierarchy = view_chunk< HierarchyEntry >(&at, end, "xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +1253,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkView< MeshEntry > meshes = view_chunk< MeshEntry >(&at, end, "msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +1262,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	ChunkView< CameraEntry > loaded_cameras = view_chunk< CameraEntry >(&at, end, "cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,17 +1273,50 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	ChunkView< LightEntry > loaded_lights = view_chunk< LightEntry >(&at, end, "lmp0");
+
+	//Optional chunks with precomputed data (written by upgrade-scene; may appear in any order):
+	struct WorldEntry {
+		glm::mat4x3 local_to_world;
+		glm::mat4x3 world_to_local;
+	};
+	static_assert(sizeof(WorldEntry) == 4*12 + 4*12, "WorldEntry is packed.");
+	ChunkView< WorldEntry > worlds; //"xfw0": world matrices for each hierarchy entry
+
+	struct BoundsEntry {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+	static_assert(sizeof(BoundsEntry) == 4*3 + 4*3, "BoundsEntry is packed.");
+	ChunkView< BoundsEntry > mesh_bounds; //"mbd0": bounds of the mesh for each mesh entry
+
+	ChunkView< uint64_t > name_hashes; //"nmh0": Name::hash_string() of each hierarchy entry's name (trusted, not re-checked)
+
+	ChunkView< uint32_t > children; //"chd0": hierarchy.size()+1 offsets into the rest of the chunk, which lists the children of each hierarchy entry
+
+	while (true) {
+		if (!worlds.data && peek_chunk(at, end, "xfw0")) worlds = view_chunk< WorldEntry >(&at, end, "xfw0");
+		else if (!mesh_bounds.data && peek_chunk(at, end, "mbd0")) mesh_bounds = view_chunk< BoundsEntry >(&at, end, "mbd0");
+		else if (!name_hashes.data && peek_chunk(at, end, "nmh0")) name_hashes = view_chunk< uint64_t >(&at, end, "nmh0");
+		else if (!children.data && peek_chunk(at, end, "chd0")) children = view_chunk< uint32_t >(&at, end, "chd0");
+		else break;
+	}
+	if ((worlds.data && worlds.size() != hierarchy.size())
+	 || (name_hashes.data && name_hashes.size() != hierarchy.size())
+	 || (mesh_bounds.data && mesh_bounds.size() != meshes.size())) {
+		throw std::runtime_error("scene file '" + filename + "' contains a precomputed data chunk that doesn't match its hierarchy or mesh chunk");
+	}
 
 
 	//--------------------------------
 	//Now that file is loaded, create transforms for hierarchy entries:
 
-	std::vector< Transform * > hierarchy_transforms;
+	bool was_empty = transforms.empty();
+	hierarchy_transforms.clear();
 	hierarchy_transforms.reserve(hierarchy.size());
 
-	for (auto const &h : hierarchy) {
+	for (size_t i = 0; i < hierarchy.size(); ++i) {
+		HierarchyEntry h = hierarchy[i];
 		transforms.emplace_back();
 		Transform *t = &transforms.back();
 		if (h.parent != -1U) {
@@ -235,7 +1327,12 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			if (name_hashes.data) {
+				//(trusted without re-hashing -- that's the point of the chunk -- since only upgrade-scene writes it; Name asserts it in debug builds)
+				t->name = Name(name_view(h.name_begin, h.name_end), name_hashes[i]);
+			} else {
+				t->name = name_view(h.name_begin, h.name_end);
+			}
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -244,26 +1341,56 @@ void Scene::load(std::string const &filename,
 		t->rotation = h.rotation;
 		t->scale = h.scale;
 
+		//start with the stored world matrices in the cache, so they needn't be computed again:
+		if (worlds.data) {
+			WorldEntry w = worlds[i];
+			Transform::WorldCache &world = t->world;
+			world.position = t->position;
+			world.rotation = t->rotation;
+			world.scale = t->scale;
+			world.parent = t->parent;
+			world.parent_version = (t->parent ? t->parent->world.version : 0);
+			world.version = 1;
+			world.local_to_world = w.local_to_world;
+			world.world_to_local = w.world_to_local;
+			//(also trusted, like nmh0; but make sure it agrees with the local transform in debug builds)
+			assert(close_to(world.local_to_world, t->parent
+				? glm::mat4x3(t->parent->world.local_to_world * glm::mat4(t->make_local_to_parent()))
+				: t->make_local_to_parent()));
+		}
+
 		hierarchy_transforms.emplace_back(t);
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
+	//the child table gives the packed (depth-sorted) order directly, if these are the only transforms:
+	if (children.data && was_empty) {
+		std::vector< uint32_t > table(children.size());
+		if (!table.empty()) std::memcpy(table.data(), children.data, table.size() * sizeof(uint32_t));
+		packed_transforms.build(hierarchy_transforms, table);
+	}
+
+	std::string name; //(reused, so that names are only allocated when they get long)
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		MeshEntry m = meshes[i];
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
 		}
 		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		name = name_view(m.name_begin, m.name_end);
 
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+		if (mesh_bounds.data) {
+			BoundsEntry b = mesh_bounds[i];
+			on_mesh(hierarchy_transforms[m.transform], name, b.min, b.max);
+		} else {
+			on_mesh(hierarchy_transforms[m.transform], name, glm::vec3(std::numeric_limits< float >::infinity()), glm::vec3(-std::numeric_limits< float >::infinity()));
 		}
-
 	}
 
-	for (auto const &c : loaded_cameras) {
+	for (size_t i = 0; i < loaded_cameras.size(); ++i) {
+		CameraEntry c = loaded_cameras[i];
 		if (c.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
 		}
@@ -278,7 +1405,8 @@ void Scene::load(std::string const &filename,
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 	}
 
-	for (auto const &l : loaded_lights) {
+	for (size_t i = 0; i < loaded_lights.size(); ++i) {
+		LightEntry l = loaded_lights[i];
 		if (l.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
 		}
@@ -301,15 +1429,117 @@ void Scene::load(std::string const &filename,
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
 
-	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	//load_extra gets its own copy of the names:
+	str0->assign(names.data, names.data + names.size());
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+	return at;
+}
+
+Scene::AsyncLoad::AsyncLoad() {
+}
+
+Scene::AsyncLoad::~AsyncLoad() {
+	//the worker thread refers to this object, so it has to finish first:
+	if (read.valid()) read.wait();
+}
+
+std::unique_ptr< Scene::AsyncLoad > Scene::load_async(std::string const &filename, std::string const &meshes_filename) {
+	std::unique_ptr< AsyncLoad > load(new AsyncLoad());
+	load->filename = filename;
+
+	AsyncLoad *l = load.get();
+	load->read = ThreadPool::shared().submit([l, meshes_filename](){
+		if (meshes_filename != "") {
+			l->meshes = std::make_shared< MeshBuffer >(meshes_filename, false); //(no OpenGL calls off the main thread)
+		}
+		l->file.reset(new MappedFile(l->filename));
+		l->staging.reset(new Scene());
+		l->rest = l->staging->load_chunks(*l->file, l->filename, [l](Transform *transform, std::string const &mesh_name, glm::vec3 const &min, glm::vec3 const &max) {
+			l->mesh_entries.emplace_back(AsyncLoad::MeshEntry{ transform, mesh_name, min, max });
+		}, &l->xfh0, &l->str0);
+	});
+
+	return load;
+}
+
+bool Scene::continue_load(AsyncLoad &load,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+	uint32_t budget) {
+
+	if (load.step == AsyncLoad::Failed) {
+		throw std::runtime_error("scene file '" + load.filename + "' failed to load (see the error from the earlier continue_load() call)");
 	}
 
+	if (load.step == AsyncLoad::Reading) {
+		if (load.read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		try {
+			load.read.get(); //(rethrows anything thrown while reading)
+		} catch (...) {
+			//get() left 'read' empty (waiting on it again is undefined), so don't come back here:
+			load.step = AsyncLoad::Failed;
+			load.staging.reset();
+			load.file.reset();
+			load.mesh_entries.clear();
+			throw;
+		}
+		if (load.meshes) load.meshes->upload();
+		load.step = AsyncLoad::Transforms;
+		//(uploading may have taken a while, so start adding things next call)
+		return false;
+	}
+
+	uint32_t work = 0;
 
+	//move up to the rest of this call's budget of objects from the staging scene to the end of one of our lists:
+	// (splicing keeps pointers valid, so parents, drawables, and xfh0 all still refer to the right transforms)
+	auto move_some = [&work, budget](auto &to, auto &from) {
+		auto last = from.begin();
+		while (last != from.end() && work < budget) {
+			++last;
+			++work;
+		}
+		to.splice(to.end(), from, from.begin(), last);
+		return from.empty();
+	};
 
+	while (work < budget && load.step != AsyncLoad::Done) {
+		if (load.step == AsyncLoad::Transforms) {
+			//(the file lists parents before children, so moved transforms never refer to ones still in staging)
+			if (move_some(transforms, load.staging->transforms)) load.step = AsyncLoad::Drawables;
+		} else if (load.step == AsyncLoad::Drawables) {
+			while (work < budget && load.next_mesh_entry < load.mesh_entries.size()) {
+				auto const &entry = load.mesh_entries[load.next_mesh_entry];
+				if (on_drawable) {
+					size_t before = drawables.size();
+					on_drawable(*this, entry.transform, entry.name);
+					set_new_drawable_bounds(before, entry.min, entry.max);
+				}
+				++load.next_mesh_entry;
+				++work;
+			}
+			if (load.next_mesh_entry == load.mesh_entries.size()) load.step = AsyncLoad::Cameras;
+		} else if (load.step == AsyncLoad::Cameras) {
+			if (move_some(cameras, load.staging->cameras)) load.step = AsyncLoad::Lights;
+		} else if (load.step == AsyncLoad::Lights) {
+			if (move_some(lights, load.staging->lights)) load.step = AsyncLoad::Extra;
+		} else if (load.step == AsyncLoad::Extra) {
+			//finish up as load() does:
+			MemoryStream rest(load.rest, load.file->data + load.file->size);
+			load_extra(rest, load.str0, load.xfh0);
+			if (rest.peek() != EOF) {
+				std::cerr << "WARNING: trailing data in scene file '" << load.filename << "'" << std::endl;
+			}
+
+			update_name_index();
+
+			load.staging.reset();
+			load.file.reset();
+			load.mesh_entries.clear();
+			load.step = AsyncLoad::Done;
+		}
+	}
+
+	return load.step == AsyncLoad::Done;
 }
 
 //-------------------------
@@ -327,51 +1557,328 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	if (&other == this) {
+		//copying a scene onto itself changes nothing (but the mapping should still be correct):
+		if (transform_map) {
+			transform_map->clear();
+			transform_map->insert(std::make_pair(nullptr, nullptr));
+			for (auto const &t : transforms) {
+				transform_map->insert(std::make_pair(&t, const_cast< Transform * >(&t)));
+			}
+		}
+		return;
+	}
 
-	transform_to_transform.clear();
+	transforms.clear();
+	drawables.clear();
+	cameras.clear();
+	lights.clear();
+
+	//bvh and octree refer to old drawables, so clear them (the bvh can be rebuilt with update_bvh()):
+	bvh = BVH();
+	bvh_drawables.clear();
+	unbounded_drawables.clear();
+	bvh_generation = 0;
+	bvh_versions.clear();
+	octree = LooseOctree(octree.root_size, octree.levels);
+	octree_drawables.clear();
+
+	instantiate(other, nullptr, transform_map);
+
+	update_name_index();
+}
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+void Scene::instantiate(Scene const &prefab, Transform *parent, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	//every copy operation gets a fresh stamp, so stale 'copy' pointers left by earlier copies are never used:
+	static std::atomic< uint32_t > next_stamp(1);
+	uint32_t stamp = next_stamp.fetch_add(1);
+	if (stamp == 0) stamp = next_stamp.fetch_add(1); //(0 means "never copied")
+
+	//look up the copy of a transform from prefab:
+	auto remap = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return parent;
+		assert(t->copy_stamp == stamp); //(checked below, before anything was copied)
+		return t->copy;
+	};
 
-	//Copy transforms and store mapping:
-	transforms.clear();
-	for (auto const &t : other.transforms) {
+	//only copy what was in prefab to begin with (in case prefab is this scene):
+	size_t transform_count = prefab.transforms.size();
+	size_t drawable_count = prefab.drawables.size();
+	size_t camera_count = prefab.cameras.size();
+	size_t light_count = prefab.lights.size();
+
+	//Stamp prefab's transforms, then make sure everything refers to one of them:
+	// (before copying anything, so that a bad prefab leaves this scene unchanged)
+	auto t = prefab.transforms.begin();
+	for (size_t i = 0; i < transform_count; ++i, ++t) {
+		t->copy = nullptr;
+		t->copy_stamp = stamp;
+	}
+	auto check = [&](Transform const *t) {
+		if (t != nullptr && t->copy_stamp != stamp) throw std::runtime_error("Scene refers to a transform that isn't in the scene.");
+	};
+	t = prefab.transforms.begin();
+	for (size_t i = 0; i < transform_count; ++i, ++t) check(t->parent);
+	auto d = prefab.drawables.begin();
+	for (size_t i = 0; i < drawable_count; ++i, ++d) check(d->transform);
+	auto cam = prefab.cameras.begin();
+	for (size_t i = 0; i < camera_count; ++i, ++cam) check(cam->transform);
+	auto l = prefab.lights.begin();
+	for (size_t i = 0; i < light_count; ++i, ++l) check(l->transform);
+
+	//Copy transforms, leaving a pointer to each copy in the original:
+	t = prefab.transforms.begin();
+	for (size_t i = 0; i < transform_count; ++i, ++t) {
 		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+		Transform &copy = transforms.back();
+		copy.name = t->name;
+		copy.position = t->position;
+		copy.rotation = t->rotation;
+		copy.scale = t->scale;
+		copy.parent = const_cast< Transform * >(t->parent); //will update below
+
+		t->copy = &copy;
 	}
 
 	//update transform parents:
+	// (the copies are the last transform_count transforms)
+	auto c = std::prev(transforms.end(), transform_count);
+	for (size_t i = 0; i < transform_count; ++i, ++c) {
+		c->parent = remap(c->parent);
+	}
+
+	//copy prefab's drawables, cameras, and lights, updating transform pointers:
+	d = prefab.drawables.begin();
+	for (size_t i = 0; i < drawable_count; ++i, ++d) {
+		drawables.emplace_back(*d);
+		drawables.back().transform = remap(d->transform);
+		drawables.back().octree_item = -1U; //(copies start out in the bvh)
+	}
+
+	cam = prefab.cameras.begin();
+	for (size_t i = 0; i < camera_count; ++i, ++cam) {
+		cameras.emplace_back(*cam);
+		cameras.back().transform = remap(cam->transform);
+	}
+
+	l = prefab.lights.begin();
+	for (size_t i = 0; i < light_count; ++i, ++l) {
+		lights.emplace_back(*l);
+		lights.back().transform = remap(l->transform);
+	}
+
+	//store mapping between transforms old and new (if requested):
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->insert(std::make_pair(nullptr, parent));
+		auto o = prefab.transforms.begin();
+		for (size_t i = 0; i < transform_count; ++i, ++o) {
+			transform_map->insert(std::make_pair(&*o, o->copy));
+		}
+	}
+}
+
+//-------------------------
+
+//State stored in snapshots for each kind of object:
+// (plain data without padding, so records can be compared with memcmp)
+struct TransformState {
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+static_assert(sizeof(TransformState) == 4*3 + 4*4 + 4*3, "TransformState is packed.");
+
+struct CameraState {
+	float fovy;
+	float aspect;
+	float clip_near;
+};
+static_assert(sizeof(CameraState) == 4*3, "CameraState is packed.");
+
+struct LightState {
+	glm::vec3 energy;
+	float spot_fov;
+	uint32_t type;
+};
+static_assert(sizeof(LightState) == 4*3 + 4 + 4, "LightState is packed.");
+
+void Scene::snapshot(Snapshot *out, Snapshot const *base) const {
+	assert(out);
+	assert(out != base);
+	if (base && (base->delta
+	 || base->transform_count != transforms.size() || base->camera_count != cameras.size() || base->light_count != lights.size())) {
+		throw std::runtime_error("Base of a delta snapshot must be a full snapshot of the same scene.");
+	}
+
+	out->transform_count = uint32_t(transforms.size());
+	out->camera_count = uint32_t(cameras.size());
+	out->light_count = uint32_t(lights.size());
+	out->delta = (base != nullptr);
+	out->changed.clear();
+	out->data.clear();
+	if (!base) {
+		out->data.resize(transforms.size() * sizeof(TransformState) + cameras.size() * sizeof(CameraState) + lights.size() * sizeof(LightState));
+	}
+
+	uint8_t *at = out->data.data(); //(full snapshots only)
+	uint8_t const *base_at = (base ? base->data.data() : nullptr);
+	uint32_t index = 0;
+	auto write = [&](auto const &state) {
+		if (base) {
+			//only store state that differs from the base:
+			if (std::memcmp(base_at, &state, sizeof(state)) != 0) {
+				out->changed.emplace_back(index);
+				out->data.insert(out->data.end(), reinterpret_cast< uint8_t const * >(&state), reinterpret_cast< uint8_t const * >(&state + 1));
+			}
+			base_at += sizeof(state);
+		} else {
+			std::memcpy(at, &state, sizeof(state));
+			at += sizeof(state);
+		}
+		++index;
+	};
+
+	for (auto const &t : transforms) {
+		write(TransformState{ t.position, t.rotation, t.scale });
+	}
+	for (auto const &c : cameras) {
+		write(CameraState{ c.fovy, c.aspect, c.near });
+	}
+	for (auto const &l : lights) {
+		write(LightState{ l.energy, l.spot_fov, uint32_t(uint8_t(l.type)) });
+	}
+}
+
+void Scene::restore(Snapshot const &snapshot, Snapshot const *base) {
+	auto fits = [this](Snapshot const &s) {
+		return s.transform_count == transforms.size() && s.camera_count == cameras.size() && s.light_count == lights.size();
+	};
+	if (!fits(snapshot)) {
+		throw std::runtime_error("Snapshot doesn't match scene (transforms, cameras, or lights were added or removed).");
+	}
+	if (snapshot.delta && (!base || base->delta || !fits(*base))) {
+		throw std::runtime_error("Restoring a delta snapshot needs the full snapshot it was made against.");
+	}
+
+	//read each object's state from the full snapshot, unless the delta has it:
+	Snapshot const &full = (snapshot.delta ? *base : snapshot);
+	uint8_t const *at = full.data.data();
+	uint8_t const *delta_at = (snapshot.delta ? snapshot.data.data() : nullptr);
+	size_t next_changed = 0;
+	uint32_t index = 0;
+	auto read = [&](auto *state) {
+		uint8_t const *from = at;
+		if (delta_at && next_changed < snapshot.changed.size() && snapshot.changed[next_changed] == index) {
+			from = delta_at;
+			delta_at += sizeof(*state);
+			++next_changed;
+		}
+		std::memcpy(state, from, sizeof(*state));
+		at += sizeof(*state);
+		++index;
+	};
+
+	for (auto &t : transforms) {
+		TransformState state;
+		read(&state);
+		t.position = state.position;
+		t.rotation = state.rotation;
+		t.scale = state.scale;
+	}
+	for (auto &c : cameras) {
+		CameraState state;
+		read(&state);
+		c.fovy = state.fovy;
+		c.aspect = state.aspect;
+		c.near = state.clip_near;
+	}
+	for (auto &l : lights) {
+		LightState state;
+		read(&state);
+		l.energy = state.energy;
+		l.spot_fov = state.spot_fov;
+		l.type = Light::Type(state.type);
+	}
+}
+
+//-------------------------
+
+Scene::Transform *Scene::find_transform(Name const &name) const {
+	return transform_names.find(name);
+}
+
+void Scene::find_transforms(Name const &name, std::vector< Transform * > *out) const {
+	assert(out);
+	transform_names.find_all(name, out);
+}
+
+void Scene::find_transforms_with_prefix(std::string_view const &prefix, std::vector< Transform * > *out) const {
+	assert(out);
+	transform_names.find_prefix(prefix, out);
+}
+
+Scene::Drawable *Scene::find_drawable(Name const &name) const {
+	return drawable_names.find(name);
+}
+
+Scene::Camera *Scene::find_camera(Name const &name) const {
+	return camera_names.find(name);
+}
+
+Scene::Light *Scene::find_light(Name const &name) const {
+	return light_names.find(name);
+}
+
+Scene::Transform *Scene::find_transform(std::string_view const &name) const {
+	return transform_names.find(name);
+}
+
+void Scene::find_transforms(std::string_view const &name, std::vector< Transform * > *out) const {
+	assert(out);
+	transform_names.find_all(name, out);
+}
+
+Scene::Drawable *Scene::find_drawable(std::string_view const &name) const {
+	return drawable_names.find(name);
+}
+
+Scene::Camera *Scene::find_camera(std::string_view const &name) const {
+	return camera_names.find(name);
+}
+
+Scene::Light *Scene::find_light(std::string_view const &name) const {
+	return light_names.find(name);
+}
+
+void Scene::update_name_index() {
+	//(lists hold objects by value, but lookups hand out non-const pointers, as with bvh_drawables)
+	std::vector< std::pair< Name, Transform * > > named_transforms;
+	named_transforms.reserve(transforms.size());
 	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+		named_transforms.emplace_back(t.name, &t);
 	}
+	transform_names.build(std::move(named_transforms));
 
-	//copy other's drawables, updating transform pointers:
-	drawables = other.drawables;
+	std::vector< std::pair< Name, Drawable * > > named_drawables;
+	named_drawables.reserve(drawables.size());
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		named_drawables.emplace_back(d.transform->name, &d);
 	}
+	drawable_names.build(std::move(named_drawables));
 
-	//copy other's cameras, updating transform pointers:
-	cameras = other.cameras;
+	std::vector< std::pair< Name, Camera * > > named_cameras;
+	named_cameras.reserve(cameras.size());
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		named_cameras.emplace_back(c.transform->name, &c);
 	}
+	camera_names.build(std::move(named_cameras));
 
-	//copy other's lights, updating transform pointers:
-	lights = other.lights;
+	std::vector< std::pair< Name, Light * > > named_lights;
+	named_lights.reserve(lights.size());
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		named_lights.emplace_back(l.transform->name, &l);
 	}
+	light_names.build(std::move(named_lights));
 }
@@ -11,21 +11,33 @@
  */
 
 #include "GL.hpp"
+#include "BVH.hpp"
+#include "LooseOctree.hpp"
+#include "Name.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <atomic>
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
+#include <future>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+struct Mesh;
+struct MeshBuffer;
+struct MappedFile;
+struct ThreadPool;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (see find_transform() and friends, below)
+		Name name;
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -40,8 +52,39 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these come from the world cache below, so repeated calls are cheap)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
+		// ..for normals (inverse transpose of local-to-world):
+		glm::mat3 make_normal_to_world() const;
+
+		//World-space matrices are cached, and only rebuilt when this transform or one of its ancestors changes.
+		// Changes are detected by comparing against the values the cache was built from,
+		// so it is fine to keep assigning position, rotation, scale, and parent directly.
+		// (checking a cache compares values all the way up the parent chain, but only rebuilds the levels that changed)
+		struct WorldCache {
+			//local state the cache was built from:
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint32_t parent_version = 0;
+
+			//incremented every time the cache is rebuilt (0 means "never built"):
+			// (useful for noticing that a transform has moved)
+			uint32_t version = 0;
+
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+		};
+		//bring the cache up to date (if needed) and return it:
+		WorldCache const &update_world() const;
+		mutable WorldCache world;
+
+		//Scratch space used while copying scenes, so that pointers can be remapped without a hash table:
+		// (copy is only valid if copy_stamp matches the current copy operation's stamp)
+		mutable Transform *copy = nullptr;
+		mutable uint32_t copy_stamp = 0;
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
@@ -52,8 +95,66 @@ struct Scene {
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
+		//..optionally drawing a mesh (sets pipeline type/start/count/index_type, bounds, and position mapping from the mesh):
+		Drawable(Transform *transform_, Mesh const &mesh) : Drawable(transform_) { set_mesh(mesh); }
 		Transform * transform;
 
+		//Bounding box of the drawable's vertices in local (transform) space:
+		// used by draw() to skip drawables outside the view frustum
+		// (an empty box -- the default -- means "unknown", and such drawables are never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//Vertex positions map to local (transform) space as position_offset + position_scale * position:
+		// (set from the mesh -- this is the identity except for quantized meshes; see Mesh)
+		// draw() folds this into the matrices it sends to the program
+		glm::vec3 position_offset = glm::vec3(0.0f);
+		glm::vec3 position_scale = glm::vec3(1.0f);
+
+		//draw a given mesh (sets pipeline type/start/count/index_type, bounds, and position mapping from the mesh):
+		// (also clears any levels of detail)
+		void set_mesh(Mesh const &mesh);
+
+		//(optional) levels of detail: coarser vertex ranges to draw when the drawable is small on screen.
+		// lods[0] should match pipeline.start/count; lods[l] is drawn while the projected size (bounding sphere radius
+		// as a fraction of viewport height) is below lods[l-1].min_size. All levels share pipeline.type, pipeline.index_type, and the bounds above.
+		enum : uint32_t { MaxLODs = 4 };
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			float min_size = 0.0f; //smallest projected size at which this level is still used (ignored for the last level)
+			glm::vec3 position_offset = glm::vec3(0.0f); //position mapping for this level (as above)
+			glm::vec3 position_scale = glm::vec3(1.0f);
+		} lods[MaxLODs];
+		uint32_t lod_count = 0; //0 means "no levels of detail, always draw pipeline.start/count"
+
+		//draw mesh 'name' from 'buffer', along with any levels of detail named name_LOD1, name_LOD2, ...:
+		// (if 'name' doesn't exist but name_LOD0 does, that is used as the full-detail mesh)
+		// each level is used down to half the projected size of the previous one, starting from 'lod0_min_size'
+		// note: will throw if neither 'name' nor name_LOD0 exists
+		void set_mesh_lods(MeshBuffer const &buffer, std::string const &name, float lod0_min_size = 0.25f);
+
+		//level drawn most recently (record() only switches levels once the size is a bit past a threshold, to avoid popping):
+		// (recording the same drawable for several views -- e.g., shadow maps -- shares this state)
+		mutable uint32_t current_lod = 0;
+
+		//index in Scene::octree_drawables (-1U if the drawable isn't in the octree):
+		uint32_t octree_item = -1U;
+
+		//number of drawables created or destroyed (in any scene):
+		// update_bvh() notes this, so bvh_current() can tell when bvh_drawables might point at drawables that are gone
+		// NOTE: this is shared by every scene (a Drawable doesn't know which scene it is in), so creating or destroying
+		//  *any* drawable -- even a temporary copy -- makes every scene's bvh look stale. draw() and the queries then
+		//  check every drawable until that scene's next update_bvh() (which only refits, if its own drawables didn't change).
+		//  So avoid making drawables in per-frame temporaries, or call update_bvh() after making them.
+		static std::atomic< uint64_t > generation;
+		struct GenerationCounter {
+			GenerationCounter() { generation.fetch_add(1, std::memory_order_relaxed); }
+			GenerationCounter(GenerationCounter const &) : GenerationCounter() { }
+			~GenerationCounter() { generation.fetch_add(1, std::memory_order_relaxed); }
+			GenerationCounter &operator=(GenerationCounter const &) { return *this; } //(assignment doesn't add or remove a drawable)
+		} generation_counter;
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -61,16 +162,52 @@ struct Scene {
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
 
-			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
-			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
-			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays (or glDrawElements)
+			GLuint start = 0; //first vertex to draw; passed to glDrawArrays (or first index, if index_type is set)
+			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays (or number of indices, if index_type is set)
+			GLenum index_type = GL_NONE; //if GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, draw with glDrawElements using the element array buffer bound in 'vao'
 
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
+			//(alternatively) read the three matrices above from a per-drawable slice of a uniform buffer:
+			// program should declare ObjectBlockGLSL and bind its "Object" block to ObjectBlockBinding
+			// (draw() writes the blocks for all visible drawables in one upload, then selects each with glBindBufferRange)
+			bool uses_object_block = false;
+			enum : uint32_t { ObjectBlockBinding = 0 };
+			static constexpr char const *ObjectBlockGLSL =
+				"layout(std140) uniform Object {\n"
+				"	mat4 OBJECT_TO_CLIP;\n"
+				"	mat4x3 OBJECT_TO_LIGHT;\n"
+				"	mat3 NORMAL_TO_LIGHT;\n"
+				"};\n";
+
+			//other per-drawable uniforms, stored as plain data (cheap to copy; applied by draw() without calling custom code):
+			// set with set_uniform(); locations refer to 'program'
+			enum : uint32_t { UniformCount = 4 };
+			struct Uniform {
+				GLuint location = -1U;
+				GLenum type = GL_NONE; //GL_FLOAT, GL_FLOAT_VEC2..4, GL_INT, GL_INT_VEC2..4, or GL_NONE (slot unused)
+				union {
+					float f[4];
+					GLint i[4];
+				} value = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			} uniforms[UniformCount];
+
+			//store a value for the uniform at 'location' (replaces any value already stored there):
+			// does nothing if location is -1U; throws if all UniformCount slots are in use
+			void set_uniform(GLuint location, float value);
+			void set_uniform(GLuint location, glm::vec2 const &value);
+			void set_uniform(GLuint location, glm::vec3 const &value);
+			void set_uniform(GLuint location, glm::vec4 const &value);
+			void set_uniform(GLuint location, GLint value);
+			void set_uniform(GLuint location, glm::ivec2 const &value);
+			void set_uniform(GLuint location, glm::ivec3 const &value);
+			void set_uniform(GLuint location, glm::ivec4 const &value);
+
+			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms (for anything the above can't express)
 
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
@@ -78,6 +215,14 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced variant of 'program', used to draw many drawables that share a mesh in one call:
+			// - per-instance matrices come from a buffer texture (GL_RGBA32F) bound to unit InstanceDataUnit,
+			//   11 texels per instance: OBJECT_TO_CLIP columns (4), OBJECT_TO_LIGHT columns (4, .w unused), NORMAL_TO_LIGHT columns (3, .w unused)
+			// - must use the same attribute locations as 'program', so that 'vao' works with both
+			// (drawables with set_uniforms are never instanced, since set_uniforms may target 'program')
+			GLuint instanced_program = 0;
+			enum : uint32_t { InstanceDataUnit = TextureCount };
 		} pipeline;
 	};
 
@@ -122,12 +267,167 @@ struct Scene {
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Packed (structure-of-arrays) mirror of the transform hierarchy:
+	// Slots are sorted by depth, so parents always precede their children and each depth level is contiguous;
+	// this allows world matrices for the whole hierarchy to be computed in one linear pass over flat arrays.
+	// The 'transforms' list stays authoritative (so Transform * users, load(), and set() work as before):
+	//  - pull() copies local position/rotation/scale out of the list
+	//  - update() computes world matrices for a range of slots
+	//  - push() stores changed results into each Transform's world cache
+	struct PackedTransforms {
+		//source transform for each slot:
+		std::vector< Transform const * > transforms;
+		//index of parent's slot (always less than own slot), or -1U for root transforms:
+		std::vector< uint32_t > parents;
+
+		//local state:
+		std::vector< glm::vec3 > positions;
+		std::vector< glm::quat > rotations;
+		std::vector< glm::vec3 > scales;
+
+		//computed by update():
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< glm::mat4x3 > world_to_local;
+
+		//slots [levels[d], levels[d+1]) are at depth d:
+		std::vector< uint32_t > levels;
+
+		//slot for each transform, in list order (used to detect changes to the list):
+		std::vector< uint32_t > slots;
+
+		//(re-)build slot ordering for a list of transforms:
+		void build(std::list< Transform > const &list);
+		//..same, for a list whose children are already known (e.g., stored in a scene file), which avoids hashing:
+		// 'list' must hold the transforms in list order; 'children' holds list.size()+1 offsets into the rest of the table, which lists each transform's children (by index in 'list')
+		// throws if the table doesn't describe the hierarchy
+		void build(std::vector< Transform * > const &list, std::vector< uint32_t > const &children);
+		//copy local state out of a list of transforms:
+		// returns false (and does nothing) if the list no longer matches the built ordering
+		bool pull(std::list< Transform > const &list);
+		//compute world matrices for slots [begin,end):
+		// (world matrices of the parents of these slots must already be computed)
+		void update(uint32_t begin, uint32_t end);
+		void update() { update(0, uint32_t(transforms.size())); }
+		//write world matrices of slots [begin,end) into the transforms' world caches:
+		// (caches of the parents of these slots must already be written)
+		void push(uint32_t begin, uint32_t end) const;
+		void push() const { push(0, uint32_t(transforms.size())); }
+	};
+	PackedTransforms packed_transforms;
+
+	//bring the world matrices of every transform up to date in one pass over packed_transforms:
+	// (rebuilds packed_transforms if the hierarchy has changed)
+	void update_world_matrices();
+
+	//..same, but spreads each depth level of the hierarchy over the threads in a pool:
+	void update_world_matrices(ThreadPool &pool);
+
+	//Bounding volume hierarchy over the world-space bounds of drawables (except those in the octree, below):
+	// draw() uses it to cull whole groups of drawables at once; raycast() and the query functions use it to find drawables.
+	// NOTE: call update_bvh() after moving transforms or adding/removing drawables (it only rebuilds if needed)
+	//  (draw(), raycast(), and the query functions notice when the bvh or octree is out of date -- see bvh_current() --
+	//   and fall back to testing every drawable, so they are never wrong, only slower)
+	BVH bvh;
+	std::vector< Drawable * > bvh_drawables; //drawable for each item in bvh
+	std::vector< Drawable * > unbounded_drawables; //drawables with empty bounds (never culled, never found by queries)
+	void update_bvh();
+
+	//what the drawables looked like at the last update_bvh(), so draw() can check that bvh and octree still match them:
+	uint64_t bvh_generation = 0; //Drawable::generation (0 means "don't use the bvh")
+	size_t bvh_drawable_count = 0; //drawables.size()
+	std::vector< uint32_t > bvh_versions; //transform->world.version for each of bvh_drawables
+	bool bvh_current() const;
+
+	//Loose octree over the world-space bounds of drawables that move a lot:
+	// refitting the bvh costs time proportional to the whole scene, while update_octree() only does work for
+	// drawables in the octree whose transforms have changed (so keep static things in the bvh and movers here)
+	// draw(), raycast(), and the query functions use both structures.
+	// NOTE: if a drawable's local bounds change, remove it from the octree and add it again
+	LooseOctree octree;
+	struct OctreeDrawable {
+		Drawable *drawable;
+		uint32_t version; //transform->world.version when the drawable was last placed in the octree
+	};
+	std::vector< OctreeDrawable > octree_drawables; //drawable for each item in octree
+	void add_to_octree(Drawable *drawable); //(drawable must have bounds; call update_bvh() afterward to take it out of the bvh)
+	void remove_from_octree(Drawable *drawable); //(call update_bvh() afterward to put it back in the bvh)
+	void update_octree();
+
+	//find the first drawable whose world-space bounds are hit by the ray origin + t * direction (t in [0,max_t]):
+	// returns nullptr if nothing is hit; sets *t (if given) to the distance along the ray
+	Drawable *raycast(glm::vec3 const &origin, glm::vec3 const &direction, float *t = nullptr, float max_t = std::numeric_limits< float >::infinity()) const;
+
+	//append drawables whose world-space bounds overlap the box [min,max]:
+	void query_aabb(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable * > *out) const;
+
+	//append drawables whose world-space bounds overlap the sphere:
+	void query_sphere(glm::vec3 const &center, float radius, std::vector< Drawable * > *out) const;
+
+	//Name lookup (objects are found by the name of their transform):
+	// NOTE: the index is built by load() and set(); call update_name_index() after adding, removing, or renaming things
+	Transform *find_transform(Name const &name) const; //first transform with name (in list order), or nullptr
+	void find_transforms(Name const &name, std::vector< Transform * > *out) const; //append all transforms with name
+	void find_transforms_with_prefix(std::string_view const &prefix, std::vector< Transform * > *out) const; //append all transforms whose names start with prefix (sorted by name)
+	Drawable *find_drawable(Name const &name) const;
+	Camera *find_camera(Name const &name) const;
+	Light *find_light(Name const &name) const;
+	//..the same, looking up strings without interning them (so looking for names that don't exist doesn't grow the name pool):
+	Transform *find_transform(std::string_view const &name) const;
+	Transform *find_transform(std::string const &name) const { return find_transform(std::string_view(name)); }
+	Transform *find_transform(char const *name) const { return find_transform(std::string_view(name)); }
+	void find_transforms(std::string_view const &name, std::vector< Transform * > *out) const;
+	void find_transforms(std::string const &name, std::vector< Transform * > *out) const { find_transforms(std::string_view(name), out); }
+	void find_transforms(char const *name, std::vector< Transform * > *out) const { find_transforms(std::string_view(name), out); }
+	Drawable *find_drawable(std::string_view const &name) const;
+	Drawable *find_drawable(std::string const &name) const { return find_drawable(std::string_view(name)); }
+	Drawable *find_drawable(char const *name) const { return find_drawable(std::string_view(name)); }
+	Camera *find_camera(std::string_view const &name) const;
+	Camera *find_camera(std::string const &name) const { return find_camera(std::string_view(name)); }
+	Camera *find_camera(char const *name) const { return find_camera(std::string_view(name)); }
+	Light *find_light(std::string_view const &name) const;
+	Light *find_light(std::string const &name) const { return find_light(std::string_view(name)); }
+	Light *find_light(char const *name) const { return find_light(std::string_view(name)); }
+
+	void update_name_index();
+	NameIndex< Transform > transform_names;
+	NameIndex< Drawable > drawable_names;
+	NameIndex< Camera > camera_names;
+	NameIndex< Light > light_names;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//draw() is record() followed by replay():
+	//One visible drawable, ready to be sent to OpenGL:
+	struct DrawCommand {
+		uint64_t key; //sort key (commands that share GL state have nearby keys)
+		Drawable const *drawable;
+		GLuint start, count; //vertex range to draw (pipeline.start/count, or a level of detail)
+		glm::mat4 object_to_clip;
+		glm::mat4x3 object_to_light;
+		glm::mat3 normal_to_light;
+	};
+
+	//cull drawables, compute their matrices, and fill 'commands' (sorted by key) -- makes no OpenGL calls:
+	// if 'pool' is given, drawables are processed on its threads
+	// NOTE: updates cached world matrices, so don't modify transforms in other threads while recording
+	void record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, std::vector< DrawCommand > *commands, ThreadPool *pool = nullptr) const;
+
+	//send recorded commands to OpenGL (drawables must not have been removed since recording):
+	void replay(std::vector< DrawCommand > const &commands) const;
+
+	//counts from the most recent call to draw() (visible and culled are set by record(), draw_calls by replay()):
+	// (show-scene displays these, which is handy for checking culling and batching)
+	struct DrawStats {
+		uint32_t visible = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view frustum
+		uint32_t draw_calls = 0; //glDraw* calls issued (instancing draws many visible drawables per call)
+	};
+	mutable DrawStats draw_stats;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -139,6 +439,60 @@ struct Scene {
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
+	//load a scene file in the background, so that big scenes don't stall the frame loop:
+	// load_async() reads and checks the file (and, optionally, a mesh buffer) on ThreadPool::shared() and returns right away;
+	// continue_load() then adds what was read to this scene, about 'budget' objects per call -- call it once per frame until it returns true.
+	// on_drawable and load_extra() are called from continue_load(), so they can use OpenGL
+	// throws (from continue_load()) on file format errors; the load is then Failed, and further calls throw too
+	struct AsyncLoad;
+	static std::unique_ptr< AsyncLoad > load_async(std::string const &filename, std::string const &meshes_filename = "");
+	bool continue_load(AsyncLoad &load,
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr,
+		uint32_t budget = 1000
+	);
+
+	struct AsyncLoad {
+		std::string filename;
+
+		//mesh buffer read along with the scene (if requested):
+		// (uploaded by the first continue_load() call after reading finishes, so it is ready for on_drawable)
+		std::shared_ptr< MeshBuffer > meshes;
+
+		AsyncLoad();
+		~AsyncLoad(); //(waits for the worker thread if it is still reading)
+		AsyncLoad(AsyncLoad const &) = delete;
+		AsyncLoad &operator=(AsyncLoad const &) = delete;
+
+		//-- internals ---
+		std::future< void > read;
+
+		//written by the worker thread (before 'read' is ready):
+		std::unique_ptr< MappedFile > file;
+		std::unique_ptr< Scene > staging; //transforms, cameras, and lights that are moved into the scene by continue_load()
+		struct MeshEntry {
+			Transform *transform;
+			std::string name;
+			glm::vec3 min, max; //(from the file, if it stores mesh bounds; otherwise an empty box)
+		};
+		std::vector< MeshEntry > mesh_entries; //passed to on_drawable by continue_load()
+		std::vector< Transform * > xfh0;
+		std::vector< char > str0;
+		char const *rest = nullptr; //where load_extra() starts reading
+
+		//what continue_load() is doing:
+		enum Step : uint8_t { Reading, Transforms, Drawables, Cameras, Lights, Extra, Done, Failed } step = Reading;
+		size_t next_mesh_entry = 0;
+	};
+
+	//-- internals for load() and load_async() ---
+	//read the main (and optional precomputed) chunks of a mapped scene file, adding transforms, cameras, and lights to this scene:
+	// mesh entries (with stored bounds, or an empty box) are passed to on_mesh; returns where the chunks end
+	char const *load_chunks(MappedFile const &file, std::string const &filename,
+		std::function< void(Transform *, std::string const &, glm::vec3 const &min, glm::vec3 const &max) > const &on_mesh,
+		std::vector< Transform * > *xfh0, std::vector< char > *str0);
+	//give drawables added since drawables.size() was 'before' the bounds [min,max], unless their bounds are already known:
+	void set_new_drawable_bounds(size_t before, glm::vec3 const &min, glm::vec3 const &max);
+
 	//empty scene:
 	Scene() = default;
 
@@ -149,5 +503,34 @@ struct Scene {
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
+	// (the mapping is only built if requested; copying itself doesn't need it)
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//append a copy of everything in 'prefab' to this scene, with prefab's root transforms parented to 'parent':
+	// copies are added to the ends of transforms, drawables, cameras, and lights (in prefab's order)
+	// (throws -- without adding anything -- if prefab refers to transforms from elsewhere)
+	// NOTE: copying a scene uses scratch space in its transforms, so don't copy the same scene from several threads at once
+	void instantiate(Scene const &prefab, Transform *parent = nullptr, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//Snapshots hold just the changeable state of a scene -- transform position/rotation/scale and camera and light parameters --
+	// packed into one buffer, for cheap checkpoints (e.g., for rewinding) without copying the whole scene.
+	// a snapshot can only be restored into the scene it came from, and only while no transforms, cameras, or lights have been added or removed
+	// (drawables, names, and hierarchy aren't included; update_bvh() / update_octree() as usual after restoring)
+	struct Snapshot {
+		//object counts when the snapshot was taken (checked by restore()):
+		uint32_t transform_count = 0, camera_count = 0, light_count = 0;
+
+		//delta snapshots only store the objects that differ from a (full) base snapshot:
+		bool delta = false;
+		std::vector< uint32_t > changed; //(delta only) sorted indices of stored objects -- transforms first, then cameras, then lights
+
+		//packed state of every object (or just the changed ones, for delta snapshots):
+		std::vector< uint8_t > data;
+	};
+
+	//capture the current state (if 'base' is given, only what differs from it):
+	void snapshot(Snapshot *out, Snapshot const *base = nullptr) const;
+	//put back captured state ('base' is required for -- and must be the one used to make -- delta snapshots):
+	// throws if the snapshot doesn't fit this scene
+	void restore(Snapshot const &snapshot, Snapshot const *base = nullptr);
 };
@@ -3,6 +3,7 @@
 #include "ShowMeshesProgram.hpp"
 #include "DrawLines.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
@@ -30,6 +31,17 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable->pipeline.count = 0;
 	}
 
+	//browse meshes in name order:
+	mesh_order.reserve(buffer.meshes.size());
+	for (uint32_t i = 0; i < buffer.meshes.size(); ++i) {
+		MeshHandle handle;
+		handle.index = i;
+		mesh_order.emplace_back(handle);
+	}
+	std::sort(mesh_order.begin(), mesh_order.end(), [this](MeshHandle a, MeshHandle b) {
+		return buffer.name(a).str() < buffer.name(b).str();
+	});
+
 	//select first mesh in buffer:
 	select_prev_mesh();
 }
@@ -152,47 +164,26 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
-	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
-	}
+	if (current_mesh == -1U || current_mesh == 0) select_mesh(0);
+	else select_mesh(current_mesh - 1);
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
+	if (current_mesh == -1U) select_mesh(0);
+	else if (current_mesh + 1 < mesh_order.size()) select_mesh(current_mesh + 1);
+	else select_mesh(current_mesh);
+}
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+void ShowMeshesMode::select_mesh(uint32_t index) {
+	if (index < mesh_order.size()) {
+		Mesh const &mesh = buffer.get(mesh_order[index]);
+		current_mesh = index;
+		current_mesh_name = buffer.name(mesh_order[index]).str();
+		scene_drawable->set_mesh(mesh);
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
+		current_mesh = -1U;
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
@@ -30,12 +30,17 @@ struct ShowMeshesMode : Mode {
 	//MeshBuffer being viewed:
 	MeshBuffer const &buffer;
 
+	//meshes in the buffer, sorted by name (the order select_prev_mesh() and select_next_mesh() step through):
+	std::vector< MeshHandle > mesh_order;
+
 	//currently selected mesh:
+	uint32_t current_mesh = -1U; //index in mesh_order (-1U if none)
 	std::string current_mesh_name = "";
 	glm::vec3 current_mesh_min = glm::vec3(0.0f);
 	glm::vec3 current_mesh_max = glm::vec3(0.0f);
 	void select_prev_mesh();
 	void select_next_mesh();
+	void select_mesh(uint32_t index); //(index in mesh_order)
 	
 	//Vertex array object used to bind mesh buffer for drawing:
 	GLuint vao = 0;
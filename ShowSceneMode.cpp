@@ -2,6 +2,7 @@
 #include "DrawLines.hpp"
 
 #include <iostream>
+#include <string>
 
 ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 
@@ -121,7 +122,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, -len)), glm::u8vec4(0x00, 0x00, 0x88, 0xff));
 
 			//transform name:
-			draw_lines.draw_text("'" + transform.name + "'",
+			draw_lines.draw_text("'" + transform.name.str() + "'",
 				xf(glm::vec3(0.05f, 0.0f, 0.05f)),
 				0.15f * xfd(glm::vec3(1.0f, 0.0f, 0.0f)),
 				0.15f * xfd(glm::vec3(0.0f, 0.0f, 1.0f)),
@@ -136,4 +137,22 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	{ //overlay culling and batching counts from the scene.draw() call above:
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines overlay(glm::mat4(
+			glm::vec4(1.0f / aspect, 0.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+		));
+		constexpr float H = 0.09f;
+		overlay.draw_text(std::to_string(scene.draw_stats.visible) + " drawn, "
+			+ std::to_string(scene.draw_stats.culled) + " culled, "
+			+ std::to_string(scene.draw_stats.draw_calls) + " draw calls",
+			glm::vec3(-aspect + 0.1f * H, -1.0f + 0.1f * H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0xff)
+		);
+	}
 }
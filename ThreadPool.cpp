@@ -0,0 +1,124 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <memory>
+
+uint32_t ThreadPool::default_workers() {
+	uint32_t hardware = std::thread::hardware_concurrency();
+	//hardware_concurrency() may return 0 if it can't tell:
+	return (hardware > 1 ? hardware - 1 : 1);
+}
+
+ThreadPool &ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool(uint32_t workers_) {
+	workers.reserve(workers_);
+	for (uint32_t i = 0; i < workers_; ++i) {
+		workers.emplace_back([this](){
+			while (true) {
+				std::function< void() > job;
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					have_jobs.wait(lock, [this](){ return stopping || !jobs.empty(); });
+					if (jobs.empty()) return; //only happens when stopping
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+				job();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		stopping = true;
+	}
+	have_jobs.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::enqueue(std::function< void() > &&job) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		jobs.emplace_back(std::move(job));
+	}
+	have_jobs.notify_one();
+}
+
+std::future< void > ThreadPool::submit(std::function< void() > const &job) {
+	auto task = std::make_shared< std::packaged_task< void() > >(job);
+	std::future< void > ret = task->get_future();
+	enqueue([task](){ (*task)(); });
+	return ret;
+}
+
+void ThreadPool::parallel_for(uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn, uint32_t min_batch) {
+	if (count == 0) return;
+
+	//a few batches per thread keeps everyone busy even if batches take different amounts of time:
+	uint32_t batch = std::max(std::max(min_batch, 1U), count / (4 * concurrency()));
+	uint32_t batches = (count + batch - 1) / batch;
+
+	//no point waking workers for a single batch:
+	if (batches == 1 || workers.empty()) {
+		fn(0, count);
+		return;
+	}
+
+	//state is shared with helper jobs, which may (harmlessly) start after this call has returned:
+	struct State {
+		std::function< void(uint32_t, uint32_t) > fn;
+		uint32_t count, batch, batches;
+		std::atomic< uint32_t > next{0};
+		std::atomic< uint32_t > done{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr exception;
+
+		void run() {
+			uint32_t b;
+			while ((b = next.fetch_add(1)) < batches) {
+				try {
+					fn(b * batch, std::min(count, (b + 1) * batch));
+				} catch (...) {
+					std::unique_lock< std::mutex > lock(mutex);
+					if (!exception) exception = std::current_exception();
+				}
+				if (done.fetch_add(1) + 1 == batches) {
+					std::unique_lock< std::mutex > lock(mutex);
+					finished.notify_all();
+				}
+			}
+		}
+	};
+	auto state = std::make_shared< State >();
+	state->fn = fn;
+	state->count = count;
+	state->batch = batch;
+	state->batches = batches;
+
+	uint32_t helpers = std::min(uint32_t(workers.size()), batches - 1);
+	for (uint32_t i = 0; i < helpers; ++i) {
+		enqueue([state](){ state->run(); });
+	}
+
+	//the calling thread works too, which guarantees progress even if all workers are busy:
+	state->run();
+
+	{
+		std::unique_lock< std::mutex > lock(state->mutex);
+		state->finished.wait(lock, [&state](){ return state->done.load() == state->batches; });
+	}
+
+	if (state->exception) std::rethrow_exception(state->exception);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * A ThreadPool keeps a set of worker threads around so that CPU-heavy work
+ * (e.g., updating large scenes) can be spread over all available cores.
+ *
+ * ThreadPool pool;
+ * pool.parallel_for(count, [&](uint32_t begin, uint32_t end) {
+ *     for (uint32_t i = begin; i < end; ++i) do_work(i);
+ * });
+ *
+ * The thread calling parallel_for() also works on the ranges, so it is safe
+ * to call parallel_for() from inside a job that is itself running on the pool.
+ *
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+	//start 'workers' worker threads:
+	// (default leaves one hardware thread for the caller of parallel_for)
+	ThreadPool(uint32_t workers = default_workers());
+	~ThreadPool();
+
+	//since workers refer to the pool, copying or moving a pool is not allowed:
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//call fn(begin, end) on disjoint ranges covering [0, count), spread over the workers and the calling thread:
+	// ranges are at least 'min_batch' long (except possibly the last one)
+	// returns once every range is done; rethrows the first exception thrown by fn (if any)
+	void parallel_for(uint32_t count, std::function< void(uint32_t begin, uint32_t end) > const &fn, uint32_t min_batch = 1);
+
+	//run a job on some worker thread; the returned future becomes ready when the job is done:
+	std::future< void > submit(std::function< void() > const &job);
+
+	//number of threads that help with parallel_for (workers + caller):
+	uint32_t concurrency() const { return uint32_t(workers.size()) + 1; }
+
+	static uint32_t default_workers();
+
+	//a pool shared by code that doesn't want to manage its own (created on first use):
+	static ThreadPool &shared();
+
+	//-- internals ---
+	void enqueue(std::function< void() > &&job);
+
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable have_jobs;
+	std::deque< std::function< void() > > jobs;
+	bool stopping = false;
+};
@@ -0,0 +1,96 @@
+//convert-meshes rewrites a .pnct file, optionally transforming its meshes on the way:
+// (the output always stores each mesh's bounds, so they needn't be computed when loading)
+// --index     merge identical vertices and store index chunks (see MeshFile.hpp), so triangles share vertices
+// --optimize  (implies --index) reorder triangles for the post-transform vertex cache and for less overdraw, and vertices for fetch locality
+//             reports the average cache miss ratio (ACMR, transformed vertices per triangle) and average transform to vertex ratio (ATVR) before and after
+// --quantize  (implies --index) store 20-byte quantized vertices instead of 36-byte ones (positions relative to each mesh's bounds, packed normals, half-float texcoords)
+
+#include "MeshFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	std::string in_file, out_file;
+	bool index = false;
+	bool optimize = false;
+	bool quantize = false;
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--index") index = true;
+		else if (arg == "--optimize") optimize = true;
+		else if (arg == "--quantize") quantize = true;
+		else if (arg.size() >= 2 && arg.substr(0, 2) == "--") usage = true;
+		else if (in_file == "") in_file = arg;
+		else if (out_file == "") out_file = arg;
+		else usage = true;
+	}
+	if (usage || in_file == "" || out_file == "") {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnct> [--index] [--optimize] [--quantize]\n"
+		             "\t--index     merge identical vertices and store indices\n"
+		             "\t--optimize  (implies --index) reorder triangles and vertices for the vertex cache and less overdraw\n"
+		             "\t--quantize  (implies --index) store compact (quantized) vertices" << std::endl;
+		return 1;
+	}
+
+	MeshFile file(in_file);
+
+	auto report = [&file](char const *label) {
+		size_t bytes = file.vertices.size() * (file.quantized ? sizeof(MeshFile::QuantizedVertex) : sizeof(MeshFile::Vertex));
+		if (file.indexed) bytes += file.indices.size() * (file.small_indices() ? 2 : 4);
+		std::cout << label << ": " << file.meshes.size() << " meshes, " << file.vertices.size() << (file.quantized ? " quantized" : "") << " vertices";
+		if (file.indexed) std::cout << ", " << file.indices.size() << (file.small_indices() ? " 16-bit" : " 32-bit") << " indices";
+		std::cout << " (" << bytes << " bytes)" << std::endl;
+	};
+
+	auto report_cache = [&file](char const *label) {
+		MeshFile::CacheStats stats = file.cache_stats();
+		std::cout << label << ": ACMR " << stats.acmr() << ", ATVR " << stats.atvr()
+			<< " (" << stats.misses << " vertices transformed for " << stats.triangles << " triangles, with a " << MeshFile::DefaultCacheSize << "-entry cache)" << std::endl;
+	};
+
+	report("read");
+	if (optimize) report_cache("read");
+
+	if (index || optimize || quantize) {
+		file.weld();
+		report("indexed");
+	}
+
+	if (quantize) {
+		file.quantize();
+		report("quantized");
+	}
+
+	//(after quantize(), so optimize() also puts any vertices it copied in fetch order)
+	if (optimize) {
+		report_cache("indexed");
+		file.optimize();
+		report("optimized");
+		report_cache("optimized");
+	}
+
+	file.compute_bounds(&ThreadPool::shared());
+	file.save(out_file);
+	std::cout << "Wrote '" << out_file << "'." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+//Plane tests shared by view-frustum culling (Scene) and region queries (BVH, LooseOctree):
+// a plane is a glm::vec4; points p are on its inside when dot(plane.xyz, p) + plane.w >= 0
+
+//planes bounding the view frustum, given a matrix that takes points to clip space:
+inline void frustum_planes(glm::mat4 const &to_clip, glm::vec4 planes[5]) {
+	//the clip-space frustum is -w <= x,y,z <= w; each side is a plane built from rows of to_clip:
+	glm::mat4 rows = glm::transpose(to_clip);
+	planes[0] = rows[3] + rows[0]; //left
+	planes[1] = rows[3] - rows[0]; //right
+	planes[2] = rows[3] + rows[1]; //bottom
+	planes[3] = rows[3] - rows[1]; //top
+	planes[4] = rows[3] + rows[2]; //near
+	//(no far plane, since cameras use infinite perspective)
+}
+
+//classify the box [min,max] as outside (-1), intersecting (0), or inside (1) the region inside all planes:
+// (conservative: boxes near corners of the region may be reported as intersecting when they are really outside)
+inline int classify_box(glm::vec4 const *planes, uint32_t plane_count, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 radius = 0.5f * (max - min);
+	int ret = 1;
+	for (uint32_t p = 0; p < plane_count; ++p) {
+		glm::vec3 normal = glm::vec3(planes[p]);
+		//distance of center from plane, and largest extent of the box toward the plane:
+		float distance = glm::dot(normal, center) + planes[p].w;
+		float extent = glm::dot(glm::abs(normal), radius);
+		if (distance + extent < 0.0f) return -1;
+		if (distance - extent < 0.0f) ret = 0;
+	}
+	return ret;
+}
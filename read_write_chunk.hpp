@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -40,6 +42,75 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//helpers for parsing chunks in place (e.g., in a MappedFile) instead of copying them:
+// (chunks needn't be aligned in memory, so elements are copied out one at a time with memcpy)
+template< typename T >
+struct ChunkView {
+	char const *data = nullptr;
+	size_t count = 0;
+
+	size_t size() const { return count; }
+	T operator[](size_t i) const {
+		assert(i < count);
+		T ret;
+		std::memcpy(&ret, data + i * sizeof(T), sizeof(T));
+		return ret;
+	}
+};
+
+//check the chunk header at *at_ and advance *at_ past the chunk (same format as read_chunk):
+template< typename T >
+ChunkView< T > view_chunk(char const **at_, char const *end, std::string const &magic) {
+	assert(at_);
+	auto &at = *at_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (at == nullptr || size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	ChunkView< T > ret;
+	ret.data = at + sizeof(header);
+	ret.count = header.size / sizeof(T);
+	at += sizeof(header) + header.size;
+	return ret;
+}
+
+//check whether the chunk at 'at' (if there is one before 'end') has the given magic number, without reading it:
+// (useful for optional chunks)
+inline bool peek_chunk(char const *at, char const *end, std::string const &magic) {
+	assert(magic.size() == 4);
+	if (at == nullptr || size_t(end - at) < 8) return false;
+	return std::memcmp(at, magic.data(), 4) == 0;
+}
+
+//..same, for chunks in a stream (leaves the stream's position unchanged):
+inline bool peek_chunk(std::istream &from, std::string const &magic) {
+	assert(magic.size() == 4);
+	std::streampos pos = from.tellg();
+	char header[8];
+	bool match = bool(from.read(header, 8)) && std::memcmp(header, magic.data(), 4) == 0;
+	from.clear();
+	from.seekg(pos);
+	return match;
+}
 
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
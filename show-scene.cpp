@@ -109,7 +109,6 @@ int main(int argc, char **argv) {
 			scene = new Scene();
 			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
 
 				scene.drawables.emplace_back(transform);
 				Scene::Drawable &drawable = scene.drawables.back();
@@ -117,9 +116,7 @@ int main(int argc, char **argv) {
 				drawable.pipeline = show_scene_program_pipeline;
 
 				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
+				drawable.set_mesh_lods(*buffer, mesh_name); //(also picks up any mesh_name_LOD1, ... meshes)
 
 			});
 		} catch (std::exception &e) {
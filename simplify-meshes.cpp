@@ -0,0 +1,491 @@
+//simplify-meshes adds simplified levels of detail of each mesh in a .pnct file:
+// mesh 'Name' gets meshes 'Name_LOD1' .. 'Name_LODN' (as Scene::Drawable::set_mesh_lods expects), with about ratio_1 .. ratio_N as many triangles
+// simplification collapses edges in order of their quadric error (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"),
+//  always onto one of the edge's existing vertices -- so levels of detail are just more index ranges over the same vertices
+// each level's error (about how far, in mesh units, it strays from the original) is stored in the file (see MeshFile.hpp)
+// meshes are simplified in parallel, biggest first, each thread taking the next mesh when it finishes one
+//(the new index ranges aren't ordered for the vertex cache; 'scenes/convert-meshes --optimize' does that)
+
+#include "MeshFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//sum of (weighted) squared distances to a set of planes, as a symmetric 4x4 matrix (upper triangle stored):
+struct Quadric {
+	double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+	double yy = 0.0, yz = 0.0, yw = 0.0;
+	double zz = 0.0, zw = 0.0;
+	double ww = 0.0;
+	double weight = 0.0; //total weight of the planes
+
+	//add plane dot(n, p) + d = 0 (n normalized) with weight w:
+	void add_plane(glm::dvec3 const &n, double d, double w) {
+		xx += w * n.x * n.x; xy += w * n.x * n.y; xz += w * n.x * n.z; xw += w * n.x * d;
+		yy += w * n.y * n.y; yz += w * n.y * n.z; yw += w * n.y * d;
+		zz += w * n.z * n.z; zw += w * n.z * d;
+		ww += w * d * d;
+		weight += w;
+	}
+
+	Quadric &operator+=(Quadric const &o) {
+		xx += o.xx; xy += o.xy; xz += o.xz; xw += o.xw;
+		yy += o.yy; yz += o.yz; yw += o.yw;
+		zz += o.zz; zw += o.zw;
+		ww += o.ww;
+		weight += o.weight;
+		return *this;
+	}
+
+	//weighted sum of squared distances from p to the planes:
+	double error(glm::dvec3 const &p) const {
+		double e = xx * p.x * p.x + yy * p.y * p.y + zz * p.z * p.z + ww
+			+ 2.0 * (xy * p.x * p.y + xz * p.x * p.z + yz * p.y * p.z)
+			+ 2.0 * (xw * p.x + yw * p.y + zw * p.z);
+		return std::max(0.0, e); //(rounding can make it slightly negative)
+	}
+};
+
+//one simplified level of a mesh:
+struct Level {
+	std::vector< uint32_t > indices; //triangle-corner indices into the file's vertices
+	float error = 0.0f;
+};
+
+//boundary edges are kept in place by planes through them, perpendicular to their triangle, weighted this much more than surface planes:
+constexpr double BorderWeight = 10.0;
+//collapses may not turn a triangle's normal further than this (cosine of the angle) from where it was:
+constexpr double MinNormalDot = 0.2;
+
+//simplify the triangles 'tris' (indices into file.vertices) to (about) each of 'targets' triangle counts, largest first:
+// (stops early -- returning fewer levels -- if no more edges can be collapsed)
+static std::vector< Level > simplify(MeshFile const &file, std::vector< uint32_t > const &tris, std::vector< uint32_t > const &targets) {
+	//--- vertices that share a position are merged (for connectivity and error), so seams don't come apart ---
+
+	std::vector< uint32_t > used(tris);
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+	std::stable_sort(used.begin(), used.end(), [&file](uint32_t a, uint32_t b) {
+		glm::vec3 const &pa = file.vertices[a].Position;
+		glm::vec3 const &pb = file.vertices[b].Position;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	});
+
+	std::vector< glm::dvec3 > positions;
+	std::vector< uint32_t > position_vertices_begin; //vertices at position p are position_vertices[position_vertices_begin[p], position_vertices_begin[p+1])
+	std::vector< uint32_t > position_vertices;
+	std::unordered_map< uint32_t, uint32_t > vertex_position;
+	for (uint32_t v : used) {
+		if (positions.empty() || glm::vec3(positions.back()) != file.vertices[v].Position) {
+			positions.emplace_back(file.vertices[v].Position);
+			position_vertices_begin.emplace_back(uint32_t(position_vertices.size()));
+		}
+		position_vertices.emplace_back(v);
+		vertex_position.emplace(v, uint32_t(positions.size() - 1));
+	}
+	position_vertices_begin.emplace_back(uint32_t(position_vertices.size()));
+
+	uint32_t tri_count = uint32_t(tris.size() / 3);
+	std::vector< uint32_t > corner_vertices(tris); //vertex used by each triangle corner (changes as positions collapse)
+	std::vector< uint32_t > corner_positions(tris.size());
+	for (uint32_t c = 0; c < tris.size(); ++c) {
+		corner_positions[c] = vertex_position.at(tris[c]);
+	}
+
+	//triangles that are already degenerate are dropped:
+	std::vector< bool > alive(tri_count, true);
+	uint32_t alive_count = 0;
+	for (uint32_t t = 0; t < tri_count; ++t) {
+		uint32_t a = corner_positions[3*t+0], b = corner_positions[3*t+1], c = corner_positions[3*t+2];
+		alive[t] = (a != b && b != c && c != a);
+		if (alive[t]) alive_count += 1;
+	}
+
+	//triangles using each position:
+	std::vector< std::vector< uint32_t > > position_tris(positions.size());
+	for (uint32_t t = 0; t < tri_count; ++t) {
+		if (!alive[t]) continue;
+		for (uint32_t i = 0; i < 3; ++i) position_tris[corner_positions[3*t+i]].emplace_back(t);
+	}
+
+	auto tri_normal = [&](uint32_t t, uint32_t moved, glm::dvec3 const &to) {
+		glm::dvec3 p[3];
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t at = corner_positions[3*t+i];
+			p[i] = (at == moved ? to : positions[at]);
+		}
+		return glm::cross(p[1] - p[0], p[2] - p[0]);
+	};
+
+	//--- quadrics (and which positions are on borders) ---
+
+	std::vector< Quadric > quadrics(positions.size());
+	std::vector< bool > border(positions.size(), false);
+	std::vector< bool > locked(positions.size(), false); //(positions on non-manifold edges stay put)
+	{
+		std::unordered_map< uint64_t, uint32_t > edge_uses; //(min,max) position pair -> number of triangles
+		auto edge_key = [](uint32_t a, uint32_t b) {
+			return (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+		};
+		for (uint32_t t = 0; t < tri_count; ++t) {
+			if (!alive[t]) continue;
+			glm::dvec3 n = tri_normal(t, -1U, glm::dvec3(0.0));
+			double length = std::sqrt(glm::dot(n, n));
+			for (uint32_t i = 0; i < 3; ++i) {
+				edge_uses[edge_key(corner_positions[3*t+i], corner_positions[3*t+(i+1)%3])] += 1;
+			}
+			if (length == 0.0) continue;
+			n /= length;
+			double d = -glm::dot(n, positions[corner_positions[3*t]]);
+			for (uint32_t i = 0; i < 3; ++i) {
+				quadrics[corner_positions[3*t+i]].add_plane(n, d, 0.5 * length);
+			}
+		}
+		for (uint32_t t = 0; t < tri_count; ++t) {
+			if (!alive[t]) continue;
+			glm::dvec3 n = tri_normal(t, -1U, glm::dvec3(0.0));
+			double length = std::sqrt(glm::dot(n, n));
+			for (uint32_t i = 0; i < 3; ++i) {
+				uint32_t a = corner_positions[3*t+i];
+				uint32_t b = corner_positions[3*t+(i+1)%3];
+				uint32_t uses = edge_uses[edge_key(a, b)];
+				if (uses > 2) {
+					locked[a] = locked[b] = true;
+				}
+				if (uses != 1) continue;
+				border[a] = border[b] = true;
+				glm::dvec3 along = positions[b] - positions[a];
+				glm::dvec3 out = glm::cross(along, n);
+				double out_length = std::sqrt(glm::dot(out, out));
+				if (length == 0.0 || out_length == 0.0) continue;
+				out /= out_length;
+				double d = -glm::dot(out, positions[a]);
+				double w = BorderWeight * glm::dot(along, along);
+				quadrics[a].add_plane(out, d, w);
+				quadrics[b].add_plane(out, d, w);
+			}
+		}
+	}
+
+	//--- collapses, cheapest first ---
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t from_version, to_version;
+		bool operator>(Collapse const &o) const { return cost > o.cost; }
+	};
+	std::priority_queue< Collapse, std::vector< Collapse >, std::greater< Collapse > > queue;
+	std::vector< uint32_t > versions(positions.size(), 0); //(bumped when a position's quadric or neighborhood changes, making queued collapses stale)
+
+	auto can_move = [&](uint32_t from, uint32_t to) {
+		if (locked[from]) return false;
+		if (border[from] && !border[to]) return false; //(would pull the border inward)
+		return true;
+	};
+	auto cost = [&](uint32_t from, uint32_t to) {
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		return q.error(positions[to]);
+	};
+	//queue the cheaper direction of collapsing edge a-b:
+	auto queue_edge = [&](uint32_t a, uint32_t b) {
+		bool ab = can_move(a, b), ba = can_move(b, a);
+		if (!ab && !ba) return;
+		double cost_ab = (ab ? cost(a, b) : 0.0);
+		double cost_ba = (ba ? cost(b, a) : 0.0);
+		if (!ab || (ba && cost_ba < cost_ab)) {
+			queue.push(Collapse{ cost_ba, b, a, versions[b], versions[a] });
+		} else {
+			queue.push(Collapse{ cost_ab, a, b, versions[a], versions[b] });
+		}
+	};
+	auto neighbors = [&](uint32_t p) {
+		std::vector< uint32_t > ret;
+		for (uint32_t t : position_tris[p]) {
+			if (!alive[t]) continue;
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (corner_positions[3*t+i] != p) ret.emplace_back(corner_positions[3*t+i]);
+			}
+		}
+		std::sort(ret.begin(), ret.end());
+		ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+		return ret;
+	};
+
+	for (uint32_t p = 0; p < positions.size(); ++p) {
+		for (uint32_t q : neighbors(p)) {
+			if (p < q) queue_edge(p, q);
+		}
+	}
+
+	//vertex at position 'to' with attributes most like vertex 'v':
+	auto closest_vertex = [&](uint32_t v, uint32_t to) {
+		MeshFile::Vertex const &from = file.vertices[v];
+		uint32_t best = position_vertices[position_vertices_begin[to]];
+		float best_distance = std::numeric_limits< float >::infinity();
+		for (uint32_t i = position_vertices_begin[to]; i < position_vertices_begin[to+1]; ++i) {
+			MeshFile::Vertex const &other = file.vertices[position_vertices[i]];
+			glm::vec3 normal = other.Normal - from.Normal;
+			glm::vec2 tex_coord = other.TexCoord - from.TexCoord;
+			glm::vec4 color = (glm::vec4(other.Color) - glm::vec4(from.Color)) / 255.0f;
+			float distance = glm::dot(normal, normal) + glm::dot(tex_coord, tex_coord) + glm::dot(color, color);
+			if (distance < best_distance) {
+				best = position_vertices[i];
+				best_distance = distance;
+			}
+		}
+		return best;
+	};
+
+	std::vector< Level > levels;
+	double max_error = 0.0; //(largest squared error -- per unit weight -- of any collapse so far)
+	for (uint32_t target : targets) {
+		while (alive_count > target && !queue.empty()) {
+			Collapse collapse = queue.top();
+			queue.pop();
+			uint32_t from = collapse.from, to = collapse.to;
+			if (collapse.from_version != versions[from] || collapse.to_version != versions[to]) continue;
+
+			//triangles around the edge, and the positions across from it:
+			uint32_t shared = 0;
+			for (uint32_t t : position_tris[from]) {
+				if (!alive[t]) continue;
+				for (uint32_t i = 0; i < 3; ++i) {
+					if (corner_positions[3*t+i] == to) shared += 1;
+				}
+			}
+			if (shared == 0 || shared > 2) continue;
+			if (border[from] && shared != 1) continue; //(border positions only move along the border)
+
+			//positions next to both ends must all be across from the edge, or the collapse would pinch the surface:
+			std::vector< uint32_t > from_neighbors = neighbors(from);
+			std::vector< uint32_t > to_neighbors = neighbors(to);
+			std::vector< uint32_t > common;
+			std::set_intersection(from_neighbors.begin(), from_neighbors.end(), to_neighbors.begin(), to_neighbors.end(), std::back_inserter(common));
+			if (common.size() != shared) continue;
+
+			//no triangle may flip (or turn too far):
+			bool flips = false;
+			for (uint32_t t : position_tris[from]) {
+				if (!alive[t]) continue;
+				if (corner_positions[3*t+0] == to || corner_positions[3*t+1] == to || corner_positions[3*t+2] == to) continue;
+				glm::dvec3 before = tri_normal(t, -1U, glm::dvec3(0.0));
+				glm::dvec3 after = tri_normal(t, from, positions[to]);
+				double lengths = std::sqrt(glm::dot(before, before) * glm::dot(after, after));
+				if (lengths == 0.0 || glm::dot(before, after) < MinNormalDot * lengths) {
+					flips = true;
+					break;
+				}
+			}
+			if (flips) continue;
+
+			//collapse:
+			Quadric merged = quadrics[from];
+			merged += quadrics[to];
+			if (merged.weight > 0.0) max_error = std::max(max_error, merged.error(positions[to]) / merged.weight);
+			quadrics[to] = merged;
+
+			for (uint32_t t : position_tris[from]) {
+				if (!alive[t]) continue;
+				if (corner_positions[3*t+0] == to || corner_positions[3*t+1] == to || corner_positions[3*t+2] == to) {
+					alive[t] = false;
+					alive_count -= 1;
+					continue;
+				}
+				for (uint32_t i = 0; i < 3; ++i) {
+					if (corner_positions[3*t+i] != from) continue;
+					corner_positions[3*t+i] = to;
+					corner_vertices[3*t+i] = closest_vertex(corner_vertices[3*t+i], to);
+				}
+				position_tris[to].emplace_back(t);
+			}
+			position_tris[from].clear();
+			position_tris[from].shrink_to_fit();
+			position_tris[to].erase(std::remove_if(position_tris[to].begin(), position_tris[to].end(), [&alive](uint32_t t){ return !alive[t]; }), position_tris[to].end());
+
+			versions[from] += 1;
+			versions[to] += 1;
+			for (uint32_t n : neighbors(to)) {
+				queue_edge(to, n);
+			}
+		}
+
+		//stop once simplification gets stuck:
+		uint32_t previous = (levels.empty() ? tri_count : uint32_t(levels.back().indices.size() / 3));
+		if (alive_count >= previous) break;
+
+		levels.emplace_back();
+		levels.back().error = float(std::sqrt(max_error));
+		levels.back().indices.reserve(3 * alive_count);
+		for (uint32_t t = 0; t < tri_count; ++t) {
+			if (!alive[t]) continue;
+			levels.back().indices.insert(levels.back().indices.end(), corner_vertices.begin() + 3*t, corner_vertices.begin() + 3*t+3);
+		}
+	}
+
+	return levels;
+}
+
+//does 'name' look like the name of a level of detail ("..._LOD<number>")?
+static bool is_lod_name(std::string const &name) {
+	size_t at = name.rfind("_LOD");
+	if (at == std::string::npos || at + 4 == name.size()) return false;
+	for (size_t i = at + 4; i < name.size(); ++i) {
+		if (name[i] < '0' || name[i] > '9') return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	std::string in_file, out_file;
+	std::vector< float > ratios{ 0.5f, 0.25f, 0.125f };
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--ratios" && argi + 1 < argc) {
+			ratios.clear();
+			std::string list = argv[++argi];
+			for (size_t begin = 0; begin <= list.size(); ) {
+				size_t end = std::min(list.find(',', begin), list.size());
+				try {
+					ratios.emplace_back(std::stof(list.substr(begin, end - begin)));
+				} catch (std::exception const &) {
+					usage = true;
+				}
+				begin = end + 1;
+			}
+		}
+		else if (arg.size() >= 2 && arg.substr(0, 2) == "--") usage = true;
+		else if (in_file == "") in_file = arg;
+		else if (out_file == "") out_file = arg;
+		else usage = true;
+	}
+	std::sort(ratios.begin(), ratios.end(), std::greater< float >());
+	ratios.erase(std::unique(ratios.begin(), ratios.end()), ratios.end());
+	for (float ratio : ratios) {
+		if (!(ratio > 0.0f && ratio < 1.0f)) usage = true;
+	}
+	if (usage || ratios.empty() || in_file == "" || out_file == "") {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnct> [--ratios 0.5,0.25,0.125]\n"
+		             "\t--ratios  fraction of each mesh's triangles to keep in each level of detail (between 0 and 1; default 0.5,0.25,0.125)" << std::endl;
+		return 1;
+	}
+
+	MeshFile file(in_file);
+	if (!file.indexed) file.weld(); //(levels of detail are index ranges)
+
+	//meshes to simplify -- each distinct range is simplified once, for every mesh that uses it:
+	std::set< std::string > names;
+	for (auto const &mesh : file.meshes) {
+		names.insert(mesh.name);
+	}
+	struct Job {
+		uint32_t begin, end;
+		std::vector< uint32_t > meshes;
+		std::vector< Level > levels;
+	};
+	std::vector< Job > jobs;
+	std::map< std::pair< uint32_t, uint32_t >, uint32_t > range_jobs;
+	for (uint32_t m = 0; m < file.meshes.size(); ++m) {
+		MeshFile::Entry const &mesh = file.meshes[m];
+		if (is_lod_name(mesh.name)) continue; //(a level of detail already)
+		if (names.count(mesh.name + "_LOD1")) {
+			std::cerr << "WARNING: mesh '" << mesh.name << "' already has levels of detail; leaving it as it is." << std::endl;
+			continue;
+		}
+		if ((mesh.end - mesh.begin) % 3 != 0) {
+			std::cerr << "WARNING: mesh '" << mesh.name << "' isn't made of triangles; leaving it as it is." << std::endl;
+			continue;
+		}
+		auto f = range_jobs.emplace(std::make_pair(mesh.begin, mesh.end), uint32_t(jobs.size()));
+		if (f.second) jobs.emplace_back(Job{ mesh.begin, mesh.end, {}, {} });
+		jobs[f.first->second].meshes.emplace_back(m);
+	}
+
+	//biggest meshes first, so the threads finish at about the same time:
+	std::vector< uint32_t > order(jobs.size());
+	for (uint32_t j = 0; j < order.size(); ++j) order[j] = j;
+	std::stable_sort(order.begin(), order.end(), [&jobs](uint32_t a, uint32_t b) {
+		return jobs[a].end - jobs[a].begin > jobs[b].end - jobs[b].begin;
+	});
+
+	//..handed out one at a time as threads become free:
+	// (parallel_for would split 'order' into contiguous batches, which would put the biggest meshes together in the first one)
+	std::atomic< uint32_t > next_job(0);
+	ThreadPool &pool = ThreadPool::shared();
+	pool.parallel_for(pool.concurrency(), [&](uint32_t, uint32_t) {
+		for (uint32_t o; (o = next_job.fetch_add(1)) < order.size(); ) {
+			Job &job = jobs[order[o]];
+			std::vector< uint32_t > tris(file.indices.begin() + job.begin, file.indices.begin() + job.end);
+			std::vector< uint32_t > targets;
+			for (float ratio : ratios) {
+				targets.emplace_back(uint32_t(std::floor(ratio * float(tris.size() / 3))));
+			}
+			job.levels = simplify(file, tris, targets);
+		}
+	});
+
+	//add the levels (in mesh order):
+	std::vector< MeshFile::Entry > added;
+	for (auto const &job : jobs) {
+		std::cout << "'" << file.meshes[job.meshes[0]].name << "'";
+		for (uint32_t m = 1; m < job.meshes.size(); ++m) std::cout << " (and '" << file.meshes[job.meshes[m]].name << "')";
+		std::cout << ": " << (job.end - job.begin) / 3 << " triangles";
+		for (uint32_t l = 0; l < job.levels.size(); ++l) {
+			Level const &level = job.levels[l];
+			uint32_t begin = uint32_t(file.indices.size());
+			file.indices.insert(file.indices.end(), level.indices.begin(), level.indices.end());
+			uint32_t end = uint32_t(file.indices.size());
+			for (uint32_t m : job.meshes) {
+				MeshFile::Entry entry = file.meshes[m];
+				entry.name += "_LOD" + std::to_string(l + 1);
+				entry.begin = begin;
+				entry.end = end;
+				entry.error = level.error;
+				added.emplace_back(entry);
+			}
+			std::cout << ", LOD" << (l + 1) << " " << (end - begin) / 3 << " (error " << level.error << ")";
+		}
+		if (job.levels.size() < ratios.size()) std::cout << " (can't be simplified further)";
+		std::cout << std::endl;
+	}
+	file.meshes.insert(file.meshes.end(), added.begin(), added.end());
+	file.errors = true;
+
+	file.compute_bounds(&ThreadPool::shared());
+	file.save(out_file);
+	std::cout << "Wrote '" << out_file << "' (" << added.size() << " levels of detail added)." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
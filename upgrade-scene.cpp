@@ -0,0 +1,207 @@
+//upgrade-scene adds the optional precomputed-data chunks that Scene::load understands to a .scene file:
+// "xfw0" - world matrices for each transform (seeds Transform world caches)
+// "mbd0" - bounds of each mesh entry's mesh (only if a .pnct file is given)
+// "nmh0" - Name::hash_string() of each transform's name (Scene::load trusts these without re-hashing, so only this tool should write them)
+// "chd0" - child table (lets Scene build its packed transform ordering without hashing)
+//Files that already have these chunks get fresh copies; any extension chunks (for load_extra) are kept as-is.
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//(these match the structures in Scene::load_chunks)
+struct HierarchyEntry {
+	uint32_t parent;
+	uint32_t name_begin;
+	uint32_t name_end;
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+
+struct MeshEntry {
+	uint32_t transform;
+	uint32_t name_begin;
+	uint32_t name_end;
+};
+static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+
+struct WorldEntry {
+	glm::mat4x3 local_to_world;
+	glm::mat4x3 world_to_local;
+};
+static_assert(sizeof(WorldEntry) == 4*12 + 4*12, "WorldEntry is packed.");
+
+struct BoundsEntry {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+static_assert(sizeof(BoundsEntry) == 4*3 + 4*3, "BoundsEntry is packed.");
+
+template< typename T >
+static std::vector< T > copy_chunk(char const **at, char const *end, std::string const &magic) {
+	ChunkView< T > view = view_chunk< T >(at, end, magic);
+	std::vector< T > ret(view.size());
+	for (size_t i = 0; i < view.size(); ++i) {
+		ret[i] = view[i];
+	}
+	return ret;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.scene> <out.scene> [meshes.pnct]\n"
+		             "(in and out may be the same file)" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+	std::string meshes_file = (argc == 4 ? argv[3] : "");
+
+	//------------ read ------------
+	//(everything is copied out, so the mapping is gone before 'out_file' -- which may be 'in_file' -- is written)
+	std::vector< char > names;
+	std::vector< HierarchyEntry > hierarchy;
+	std::vector< MeshEntry > meshes;
+	std::vector< char > cameras, lights;
+	std::vector< char > rest;
+	{
+		MappedFile file(in_file);
+		char const *at = file.data;
+		char const *end = file.data + file.size;
+		names = copy_chunk< char >(&at, end, "str0");
+		hierarchy = copy_chunk< HierarchyEntry >(&at, end, "xfh0");
+		meshes = copy_chunk< MeshEntry >(&at, end, "msh0");
+		cameras = copy_chunk< char >(&at, end, "cam0");
+		lights = copy_chunk< char >(&at, end, "lmp0");
+
+		//drop old precomputed chunks (they are rebuilt below):
+		while (peek_chunk(at, end, "xfw0") || peek_chunk(at, end, "mbd0") || peek_chunk(at, end, "nmh0") || peek_chunk(at, end, "chd0")) {
+			view_chunk< char >(&at, end, std::string(at, 4));
+		}
+
+		rest.assign(at, end);
+	}
+
+	//------------ compute ------------
+
+	//world matrices (computed just as Scene does):
+	Scene scene;
+	std::vector< Scene::Transform * > transforms;
+	transforms.reserve(hierarchy.size());
+	for (auto const &h : hierarchy) {
+		if (h.parent != -1U && h.parent >= transforms.size()) {
+			throw std::runtime_error("scene file '" + in_file + "' did not contain transforms in topological-sort order.");
+		}
+		if (!(h.name_begin <= h.name_end && h.name_end <= names.size())) {
+			throw std::runtime_error("scene file '" + in_file + "' contains hierarchy entry with invalid name indices");
+		}
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
+		t->parent = (h.parent == -1U ? nullptr : transforms[h.parent]);
+		t->position = h.position;
+		t->rotation = h.rotation;
+		t->scale = h.scale;
+		transforms.emplace_back(t);
+	}
+	std::vector< WorldEntry > worlds;
+	worlds.reserve(transforms.size());
+	for (auto t : transforms) {
+		Scene::Transform::WorldCache const &world = t->update_world();
+		worlds.emplace_back(WorldEntry{ world.local_to_world, world.world_to_local });
+	}
+
+	//name hashes:
+	std::vector< uint64_t > name_hashes;
+	name_hashes.reserve(hierarchy.size());
+	for (auto const &h : hierarchy) {
+		name_hashes.emplace_back(Name::hash_string(std::string_view(names.data() + h.name_begin, h.name_end - h.name_begin)));
+	}
+
+	//child table -- offsets (one per transform, plus one), then children in file order:
+	std::vector< uint32_t > children(hierarchy.size() + 1, 0);
+	for (auto const &h : hierarchy) {
+		if (h.parent != -1U) children[h.parent + 1] += 1;
+	}
+	for (size_t i = 1; i < children.size(); ++i) {
+		children[i] += children[i-1];
+	}
+	children.resize(hierarchy.size() + 1 + children.back());
+	{
+		std::vector< uint32_t > next(children.begin(), children.begin() + hierarchy.size());
+		uint32_t *kids = children.data() + hierarchy.size() + 1;
+		for (uint32_t i = 0; i < hierarchy.size(); ++i) {
+			if (hierarchy[i].parent != -1U) kids[next[hierarchy[i].parent]++] = i;
+		}
+	}
+
+	//mesh bounds:
+	std::vector< BoundsEntry > bounds;
+	if (meshes_file != "") {
+		MeshBuffer buffer(meshes_file, false); //(no OpenGL needed)
+		bounds.reserve(meshes.size());
+		for (auto const &m : meshes) {
+			if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+				throw std::runtime_error("scene file '" + in_file + "' contains mesh entry with invalid name indices");
+			}
+			std::string name(names.data() + m.name_begin, names.data() + m.name_end);
+			BoundsEntry b;
+			b.min = glm::vec3( std::numeric_limits< float >::infinity());
+			b.max = glm::vec3(-std::numeric_limits< float >::infinity());
+			if (Mesh const *mesh = buffer.find(name)) {
+				b.min = mesh->min;
+				b.max = mesh->max;
+			} else {
+				std::cerr << "WARNING: mesh '" << name << "' isn't in '" << meshes_file << "'; its bounds will be left unknown." << std::endl;
+			}
+			bounds.emplace_back(b);
+		}
+	}
+
+	//------------ write ------------
+	std::ofstream out(out_file, std::ios::binary);
+	write_chunk("str0", names, &out);
+	write_chunk("xfh0", hierarchy, &out);
+	write_chunk("msh0", meshes, &out);
+	write_chunk("cam0", cameras, &out);
+	write_chunk("lmp0", lights, &out);
+	write_chunk("xfw0", worlds, &out);
+	if (meshes_file != "") {
+		write_chunk("mbd0", bounds, &out);
+	}
+	write_chunk("nmh0", name_hashes, &out);
+	write_chunk("chd0", children, &out);
+	out.write(rest.data(), rest.size());
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + out_file + "'.");
+	}
+
+	std::cout << "Wrote '" << out_file << "' (" << hierarchy.size() << " transforms, " << meshes.size() << " mesh entries"
+		<< (meshes_file != "" ? ", with mesh bounds" : "") << ")." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}